@@ -0,0 +1,324 @@
+#include "avl.h"
+
+static inline void __avl_change_child(struct avl_node *old, struct avl_node *new,
+				      struct avl_node *parent, struct avl_root *root)
+{
+	if (parent) {
+		if (parent->avl_left == old)
+			parent->avl_left = new;
+		else
+			parent->avl_right = new;
+	} else
+		root->avl_node = new;
+}
+
+/* The rotations only relink; callers fix up the balance factors */
+static void __avl_rotate_left(struct avl_node *node, struct avl_root *root)
+{
+	struct avl_node *right = node->avl_right;
+	struct avl_node *parent = avl_parent(node);
+
+	if ((node->avl_right = right->avl_left))
+		avl_set_parent(right->avl_left, node);
+	right->avl_left = node;
+
+	avl_set_parent(right, parent);
+	__avl_change_child(node, right, parent, root);
+	avl_set_parent(node, right);
+}
+
+static void __avl_rotate_right(struct avl_node *node, struct avl_root *root)
+{
+	struct avl_node *left = node->avl_left;
+	struct avl_node *parent = avl_parent(node);
+
+	if ((node->avl_left = left->avl_right))
+		avl_set_parent(left->avl_right, node);
+	left->avl_right = node;
+
+	avl_set_parent(left, parent);
+	__avl_change_child(node, left, parent, root);
+	avl_set_parent(node, left);
+}
+
+/*
+ * After a double rotation @x roots the subtree with @left and @right as
+ * its children; x's old balance decides which of them ends up lopsided.
+ */
+static inline void __avl_double_balance(struct avl_node *x, struct avl_node *left,
+					struct avl_node *right)
+{
+	int balance = avl_balance(x);
+
+	avl_set_balance(left, balance > 0 ? -1 : 0);
+	avl_set_balance(right, balance < 0 ? 1 : 0);
+	avl_set_balance(x, 0);
+}
+
+/*
+ * Walk up from the new leaf while subtrees keep growing.  Retracing ends
+ * at the first node that absorbs the growth, or after one (double)
+ * rotation, which always restores the subtree's previous height.
+ */
+void avl_insert_rebalance(struct avl_node *node, struct avl_root *root)
+{
+	struct avl_node *parent;
+
+	while ((parent = avl_parent(node)) != NULL)
+	{
+		if (node == parent->avl_left)
+		{
+			if (avl_balance(parent) > 0) {
+				avl_set_balance(parent, 0);
+				return;
+			}
+			if (avl_balance(parent) == 0) {
+				avl_set_balance(parent, -1);
+				node = parent;
+				continue;
+			}
+
+			if (avl_balance(node) < 0) {
+				__avl_rotate_right(parent, root);
+				avl_set_balance(parent, 0);
+				avl_set_balance(node, 0);
+			} else {
+				struct avl_node *x = node->avl_right;
+
+				__avl_rotate_left(node, root);
+				__avl_rotate_right(parent, root);
+				__avl_double_balance(x, node, parent);
+			}
+			return;
+		} else {
+			if (avl_balance(parent) < 0) {
+				avl_set_balance(parent, 0);
+				return;
+			}
+			if (avl_balance(parent) == 0) {
+				avl_set_balance(parent, 1);
+				node = parent;
+				continue;
+			}
+
+			if (avl_balance(node) > 0) {
+				__avl_rotate_left(parent, root);
+				avl_set_balance(parent, 0);
+				avl_set_balance(node, 0);
+			} else {
+				struct avl_node *x = node->avl_left;
+
+				__avl_rotate_right(node, root);
+				__avl_rotate_left(parent, root);
+				__avl_double_balance(x, parent, node);
+			}
+			return;
+		}
+	}
+}
+
+/*
+ * One of @parent's subtrees (the left one if @left) lost a level.  Walk
+ * up while subtree heights keep shrinking; stop at the first node that
+ * absorbs the change, including after a rotation around a balanced sibling.
+ */
+static void __avl_erase_retrace(struct avl_node *parent, int left,
+				struct avl_root *root)
+{
+	struct avl_node *node, *sibling;
+
+	while (parent)
+	{
+		if (left)
+		{
+			if (avl_balance(parent) < 0) {
+				avl_set_balance(parent, 0);
+				node = parent;
+			} else if (avl_balance(parent) == 0) {
+				avl_set_balance(parent, 1);
+				return;
+			} else {
+				sibling = parent->avl_right;
+				if (avl_balance(sibling) < 0) {
+					node = sibling->avl_left;
+					__avl_rotate_right(sibling, root);
+					__avl_rotate_left(parent, root);
+					__avl_double_balance(node, parent, sibling);
+				} else {
+					__avl_rotate_left(parent, root);
+					if (avl_balance(sibling) == 0) {
+						avl_set_balance(parent, 1);
+						avl_set_balance(sibling, -1);
+						return;
+					}
+					avl_set_balance(parent, 0);
+					avl_set_balance(sibling, 0);
+					node = sibling;
+				}
+			}
+		} else {
+			if (avl_balance(parent) > 0) {
+				avl_set_balance(parent, 0);
+				node = parent;
+			} else if (avl_balance(parent) == 0) {
+				avl_set_balance(parent, -1);
+				return;
+			} else {
+				sibling = parent->avl_left;
+				if (avl_balance(sibling) > 0) {
+					node = sibling->avl_right;
+					__avl_rotate_left(sibling, root);
+					__avl_rotate_right(parent, root);
+					__avl_double_balance(node, sibling, parent);
+				} else {
+					__avl_rotate_right(parent, root);
+					if (avl_balance(sibling) == 0) {
+						avl_set_balance(parent, -1);
+						avl_set_balance(sibling, 1);
+						return;
+					}
+					avl_set_balance(parent, 0);
+					avl_set_balance(sibling, 0);
+					node = sibling;
+				}
+			}
+		}
+
+		/* @node roots a subtree that is one level shorter than before */
+		parent = avl_parent(node);
+		if (parent)
+			left = (node == parent->avl_left);
+	}
+}
+
+void avl_erase(struct avl_node *node, struct avl_root *root)
+{
+	struct avl_node *child, *parent;
+	int left = 0;
+
+	if (!node->avl_left || !node->avl_right)
+	{
+		child = node->avl_left ? node->avl_left : node->avl_right;
+		parent = avl_parent(node);
+
+		if (parent)
+			left = (node == parent->avl_left);
+		if (child)
+			avl_set_parent(child, parent);
+		__avl_change_child(node, child, parent, root);
+	}
+	else
+	{
+		struct avl_node *successor = node->avl_right, *tmp;
+
+		while ((tmp = successor->avl_left) != NULL)
+			successor = tmp;
+
+		child = successor->avl_right;
+		parent = avl_parent(successor);
+
+		if (parent == node) {
+			/* The successor keeps its right subtree, which shrank by it */
+			parent = successor;
+		} else {
+			if (child)
+				avl_set_parent(child, parent);
+			parent->avl_left = child;
+			left = 1;
+
+			successor->avl_right = node->avl_right;
+			avl_set_parent(node->avl_right, successor);
+		}
+
+		successor->avl_left = node->avl_left;
+		avl_set_parent(node->avl_left, successor);
+		successor->avl_parent_balance = node->avl_parent_balance;
+
+		__avl_change_child(node, successor, avl_parent(node), root);
+	}
+
+	__avl_erase_retrace(parent, left, root);
+}
+
+/*
+ * This function returns the first node (in sort order) of the tree.
+ */
+struct avl_node *avl_first(const struct avl_root *root)
+{
+	struct avl_node	*n;
+
+	n = root->avl_node;
+	if (!n)
+		return NULL;
+	while (n->avl_left)
+		n = n->avl_left;
+	return n;
+}
+
+struct avl_node *avl_last(const struct avl_root *root)
+{
+	struct avl_node	*n;
+
+	n = root->avl_node;
+	if (!n)
+		return NULL;
+	while (n->avl_right)
+		n = n->avl_right;
+	return n;
+}
+
+struct avl_node *avl_next(const struct avl_node *node)
+{
+	struct avl_node *parent;
+
+	/* If we have a right-hand child, go down and then left as far
+	   as we can. */
+	if (node->avl_right) {
+		node = node->avl_right;
+		while (node->avl_left)
+			node = node->avl_left;
+		return (struct avl_node *)node;
+	}
+
+	/* No right-hand children: go up until we arrive from a left-hand
+	   child; that parent is our 'next' node. */
+	while ((parent = avl_parent(node)) && node == parent->avl_right)
+		node = parent;
+
+	return parent;
+}
+
+struct avl_node *avl_prev(const struct avl_node *node)
+{
+	struct avl_node *parent;
+
+	/* If we have a left-hand child, go down and then right as far
+	   as we can. */
+	if (node->avl_left) {
+		node = node->avl_left;
+		while (node->avl_right)
+			node = node->avl_right;
+		return (struct avl_node *)node;
+	}
+
+	/* No left-hand children. Go up till we find an ancestor which
+	   is a right-hand child of its parent */
+	while ((parent = avl_parent(node)) && node == parent->avl_left)
+		node = parent;
+
+	return parent;
+}
+
+void avl_replace_node(struct avl_node *victim, struct avl_node *new,
+		      struct avl_root *root)
+{
+	/* Copy the pointers/balance from the victim to the replacement */
+	*new = *victim;
+
+	/* Set the surrounding nodes to point to the replacement */
+	if (victim->avl_left)
+		avl_set_parent(victim->avl_left, new);
+	if (victim->avl_right)
+		avl_set_parent(victim->avl_right, new);
+	__avl_change_child(victim, new, avl_parent(victim), root);
+}
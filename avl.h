@@ -0,0 +1,84 @@
+/*
+ * Intrusive AVL trees
+ *
+ * The AVL counterpart of rbtree.h: struct avl_node is embedded in the
+ * user's own structure and found again with avl_entry(), so indexing a
+ * record costs no extra allocation or pointer chase.  As with rbtrees the
+ * user does the descent, then links and rebalances:
+ *
+ *	struct avl_node **link = &root->avl_node, *parent = NULL;
+ *
+ *	while (*link) {
+ *		parent = *link;
+ *		if (data->key < avl_entry(parent, struct mytype, node)->key)
+ *			link = &parent->avl_left;
+ *		else
+ *			link = &parent->avl_right;
+ *	}
+ *	avl_link_node(&data->node, parent, link);
+ *	avl_insert_rebalance(&data->node, root);
+ *
+ * Like rb_parent_color, avl_parent_balance packs the balance factor
+ * (height of the right subtree minus that of the left, -1..1, stored
+ * offset by one) into the two low bits of the parent pointer, so a node is
+ * just three words: the same size as an rb_node.
+ */
+
+#ifndef	_AVL_H
+#define	_AVL_H
+
+#include "rbtree.h"	/* container_of(), offsetof(), NULL */
+
+struct avl_node
+{
+	unsigned long  avl_parent_balance;
+	struct avl_node *avl_right;
+	struct avl_node *avl_left;
+} __attribute__((aligned(sizeof(long))));
+
+struct avl_root
+{
+	struct avl_node *avl_node;
+};
+
+#define avl_parent(r)   ((struct avl_node *)((r)->avl_parent_balance & ~3))
+#define avl_balance(r)  ((int)((r)->avl_parent_balance & 3) - 1)
+
+static inline void avl_set_parent(struct avl_node *avl, struct avl_node *p)
+{
+	avl->avl_parent_balance = (avl->avl_parent_balance & 3) | (unsigned long)p;
+}
+static inline void avl_set_balance(struct avl_node *avl, int balance)
+{
+	avl->avl_parent_balance = (avl->avl_parent_balance & ~3) | (balance + 1);
+}
+
+#define AVL_ROOT	(struct avl_root) { NULL, }
+#define	avl_entry(ptr, type, member) container_of(ptr, type, member)
+
+#define AVL_EMPTY_ROOT(root)	((root)->avl_node == NULL)
+
+extern void avl_insert_rebalance(struct avl_node *, struct avl_root *);
+extern void avl_erase(struct avl_node *, struct avl_root *);
+
+/* Find logical next and previous nodes in a tree */
+extern struct avl_node *avl_next(const struct avl_node *);
+extern struct avl_node *avl_prev(const struct avl_node *);
+extern struct avl_node *avl_first(const struct avl_root *);
+extern struct avl_node *avl_last(const struct avl_root *);
+
+/* Fast replacement of a single node without remove/rebalance/add/rebalance */
+extern void avl_replace_node(struct avl_node *victim, struct avl_node *new,
+			     struct avl_root *root);
+
+static inline void avl_link_node(struct avl_node * node, struct avl_node * parent,
+				 struct avl_node ** avl_link)
+{
+	/* A new leaf is balanced: balance 0 is stored as 1 */
+	node->avl_parent_balance = (unsigned long)parent | 1;
+	node->avl_left = node->avl_right = NULL;
+
+	*avl_link = node;
+}
+
+#endif	/* _AVL_H */
@@ -3,16 +3,34 @@
 #include <time.h>
 #include <sys/resource.h>
 #include <string.h>
+#include <malloc.h>
+#include <math.h>
+#include <unistd.h>
 #include "rbtree.h"
+#include "rbtree_join.h"
+#include "rbtree32.h"
 #include "avltree.h"
+#include "avl.h"
+#include "btree.h"
+#include "node_pool.h"
+#include "bench.h"
+#include "perf_counters.h"
+#include "workload.h"
+#include "results.h"
+#include "thread_pool.h"
 
-// Function to measure time in seconds
-double get_time_in_seconds(clock_t start, clock_t end) {
-    return (double)(end - start) / CLOCKS_PER_SEC;
-}
-
-// Function to measure memory usage in kilobytes
+// Function to measure memory usage in kilobytes: the current resident set,
+// or the peak one where /proc is not available
 long get_memory_usage() {
+    long pages, resident;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm) {
+        int ok = fscanf(statm, "%ld %ld", &pages, &resident) == 2;
+        fclose(statm);
+        if (ok)
+            return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
     struct rusage usage;
     getrusage(RUSAGE_SELF, &usage);
     return usage.ru_maxrss;
@@ -24,6 +42,47 @@ struct my_node {
     struct rb_node rb;
 };
 
+// The same user structure indexed by the intrusive AVL tree
+struct my_avl_node {
+    int key;
+    struct avl_node avl;
+};
+
+// Node allocation: malloc, or the node pools when use_node_pool is set
+static struct node_pool rb_pool, avl_pool, iavl_pool;
+static int use_node_pool = 0;
+
+static struct my_node *alloc_my_node(void) {
+    if (use_node_pool)
+        return node_pool_alloc(&rb_pool);
+    return malloc(sizeof(struct my_node));
+}
+
+static void free_my_node(struct my_node *data) {
+    if (use_node_pool)
+        node_pool_free(&rb_pool, data);
+    else
+        free(data);
+}
+
+static struct my_avl_node *alloc_my_avl_node(void) {
+    if (use_node_pool)
+        return node_pool_alloc(&iavl_pool);
+    return malloc(sizeof(struct my_avl_node));
+}
+
+static void free_my_avl_node(struct my_avl_node *data) {
+    if (use_node_pool)
+        node_pool_free(&iavl_pool, data);
+    else
+        free(data);
+}
+
+static void set_node_allocator(int pool) {
+    use_node_pool = pool;
+    avltree_set_node_pool(pool ? &avl_pool : NULL);
+}
+
 // RB tree functions
 static int rb_comparison_count = 0;
 
@@ -73,7 +132,7 @@ static int rb_insert(struct rb_root *root, struct my_node *data) {
 static void rb_delete(struct rb_root *root, struct my_node *data) {
     rb_comparison_count = 0;
     rb_erase(&data->rb, root);
-    free(data);
+    free_my_node(data);
 }
 
 // AVL tree functions
@@ -103,6 +162,60 @@ Node* avl_delete(AVLTree tree, int key) {
     return avltree_delete(tree, key);
 }
 
+// Non-recursive variants with early-terminating retrace
+Node* avl_insert_iterative(AVLTree tree, int key) {
+    avl_comparison_count = 0;
+    return iterative_avltree_insert(tree, key);
+}
+
+Node* avl_delete_iterative(AVLTree tree, int key) {
+    avl_comparison_count = 0;
+    return iterative_avltree_delete(tree, key);
+}
+
+// Intrusive AVL tree functions
+static struct avl_node *iavl_search(struct avl_root *root, int key) {
+    struct avl_node *node = root->avl_node;
+
+    while (node) {
+        struct my_avl_node *data = avl_entry(node, struct my_avl_node, avl);
+
+        if (key < data->key)
+            node = node->avl_left;
+        else if (key > data->key)
+            node = node->avl_right;
+        else
+            return node;
+    }
+    return NULL;
+}
+
+static int iavl_insert(struct avl_root *root, struct my_avl_node *data) {
+    struct avl_node **new = &(root->avl_node), *parent = NULL;
+
+    while (*new) {
+        struct my_avl_node *this = avl_entry(*new, struct my_avl_node, avl);
+
+        parent = *new;
+        if (data->key < this->key)
+            new = &((*new)->avl_left);
+        else if (data->key > this->key)
+            new = &((*new)->avl_right);
+        else
+            return 0;
+    }
+
+    avl_link_node(&data->avl, parent, new);
+    avl_insert_rebalance(&data->avl, root);
+
+    return 1;
+}
+
+static void iavl_delete(struct avl_root *root, struct my_avl_node *data) {
+    avl_erase(&data->avl, root);
+    free_my_avl_node(data);
+}
+
 // Generate gnuplot script
 void generate_gnuplot_script(const char* data_filename, const char* script_filename, const char* output_filename, const char* title, const char* ylabel) {
     FILE* script_file = fopen(script_filename, "w");
@@ -118,31 +231,29 @@ void generate_gnuplot_script(const char* data_filename, const char* script_filen
     fprintf(script_file, "set ylabel '%s'\n", ylabel);
     fprintf(script_file, "set key left top\n");
     fprintf(script_file, "set grid\n");
-    fprintf(script_file, "plot '%s' using 1:2 title 'Red-Black Tree' with lines,\\\n", data_filename);
-    fprintf(script_file, "     '%s' using 1:3 title 'AVL Tree' with lines\n", data_filename);
+    fprintf(script_file, "plot '%s' using 1:2:11 title 'Red-Black Tree' with yerrorlines,\\\n", data_filename);
+    fprintf(script_file, "     '%s' using 1:3:12 title 'AVL Tree' with yerrorlines,\\\n", data_filename);
+    fprintf(script_file, "     '%s' using 1:4:13 title 'Red-Black Tree (pool)' with yerrorlines,\\\n", data_filename);
+    fprintf(script_file, "     '%s' using 1:5:14 title 'AVL Tree (pool)' with yerrorlines,\\\n", data_filename);
+    fprintf(script_file, "     '%s' using 1:6:15 title 'Intrusive AVL Tree' with yerrorlines,\\\n", data_filename);
+    fprintf(script_file, "     '%s' using 1:7:16 title 'Intrusive AVL Tree (pool)' with yerrorlines,\\\n", data_filename);
+    fprintf(script_file, "     '%s' using 1:8:17 title 'Iterative AVL Tree' with yerrorlines,\\\n", data_filename);
+    fprintf(script_file, "     '%s' using 1:9:18 title 'Iterative AVL Tree (pool)' with yerrorlines,\\\n", data_filename);
+    fprintf(script_file, "     '%s' using 1:10:19 title 'B+Tree' with yerrorlines\n", data_filename);
 
     fclose(script_file);
 }
 
-// Measure cache misses
-void measure_cache_misses(const char* operation, int n, long* cache_misses) {
-    char command[256];
-    sprintf(command, "perf stat -e cache-misses ./rbtree-tst-perf-helper %s %d 2>&1 | grep 'cache-misses' | awk '{print $1}'", operation, n);
-
-    FILE* perf_output = popen(command, "r");
-    if (!perf_output) {
-        perror("Error running perf command");
-        exit(1);
-    }
-
-    char buffer[128];
-    if (fgets(buffer, sizeof(buffer), perf_output) != NULL) {
-        *cache_misses = atol(buffer);
-    } else {
-        *cache_misses = 0; // Default to 0 if parsing fails
+// One row of per-operation counter averages; -1 for events that could not be counted
+void print_counters(FILE* file, int n, const char* tree, const struct perf_counters* pc, long ops) {
+    fprintf(file, "%d %s", n, tree);
+    for (int i = 0; i < PERF_NR_COUNTERS; i++) {
+        if (perf_counter_available(pc, i))
+            fprintf(file, " %f", (double)perf_counter_read(pc, i) / ops);
+        else
+            fprintf(file, " -1");
     }
-
-    pclose(perf_output);
+    fprintf(file, "\n");
 }
 
 void generate_unique_random_keys(int* keys, int n) {
@@ -158,6 +269,187 @@ void generate_unique_random_keys(int* keys, int n) {
     }
 }
 
+// Each run_* builds its tree from @keys (unless measuring insertion),
+// times and counts hardware events (into @pc) for @operation over all keys
+// as one batch, releases the tree and returns the time per operation in
+// nanoseconds.
+static double run_rbtree(const char* operation, const int* keys, int n, struct perf_counters* pc) {
+    struct rb_root tree = RB_ROOT;
+    struct my_node** nodes = malloc(n * sizeof(struct my_node*));
+    uint64_t start, end;
+
+    if (strcmp(operation, "insert") != 0) {
+        for (int i = 0; i < n; i++) {
+            nodes[i] = alloc_my_node();
+            nodes[i]->key = keys[i];
+            rb_insert(&tree, nodes[i]);
+        }
+    }
+
+    perf_counters_start(pc);
+    start = bench_now();
+    if (strcmp(operation, "insert") == 0) {
+        for (int i = 0; i < n; i++) {
+            nodes[i] = alloc_my_node();
+            nodes[i]->key = keys[i];
+            rb_insert(&tree, nodes[i]);
+        }
+    } else if (strcmp(operation, "search") == 0) {
+        for (int i = 0; i < n; i++)
+            bench_do_not_optimize(rb_search(&tree, keys[i]));
+    } else {
+        for (int i = 0; i < n; i++)
+            rb_delete(&tree, nodes[i]);
+    }
+    end = bench_now();
+    perf_counters_stop(pc);
+
+    struct rb_node *node;
+    while ((node = tree.rb_node) != NULL)
+        rb_delete(&tree, rb_entry(node, struct my_node, rb));
+    free(nodes);
+    return bench_ns_per_op(start, end, n);
+}
+
+static double run_avltree(const char* operation, const int* keys, int n, int iterative, struct perf_counters* pc) {
+    Node* (*insert)(AVLTree, int) = iterative ? avl_insert_iterative : avl_insert;
+    Node* (*delete)(AVLTree, int) = iterative ? avl_delete_iterative : avl_delete;
+    AVLTree tree = NULL;
+    uint64_t start, end;
+
+    if (strcmp(operation, "insert") != 0) {
+        for (int i = 0; i < n; i++)
+            tree = insert(tree, keys[i]);
+    }
+
+    perf_counters_start(pc);
+    start = bench_now();
+    if (strcmp(operation, "insert") == 0) {
+        for (int i = 0; i < n; i++)
+            tree = insert(tree, keys[i]);
+    } else if (strcmp(operation, "search") == 0) {
+        for (int i = 0; i < n; i++)
+            bench_do_not_optimize(avl_search(tree, keys[i]));
+    } else {
+        for (int i = 0; i < n; i++)
+            tree = delete(tree, keys[i]);
+    }
+    end = bench_now();
+    perf_counters_stop(pc);
+
+    destroy_avltree(tree);
+    return bench_ns_per_op(start, end, n);
+}
+
+static double run_intrusive_avl(const char* operation, const int* keys, int n, struct perf_counters* pc) {
+    struct avl_root tree = AVL_ROOT;
+    struct my_avl_node** nodes = malloc(n * sizeof(struct my_avl_node*));
+    uint64_t start, end;
+
+    if (strcmp(operation, "insert") != 0) {
+        for (int i = 0; i < n; i++) {
+            nodes[i] = alloc_my_avl_node();
+            nodes[i]->key = keys[i];
+            iavl_insert(&tree, nodes[i]);
+        }
+    }
+
+    perf_counters_start(pc);
+    start = bench_now();
+    if (strcmp(operation, "insert") == 0) {
+        for (int i = 0; i < n; i++) {
+            nodes[i] = alloc_my_avl_node();
+            nodes[i]->key = keys[i];
+            iavl_insert(&tree, nodes[i]);
+        }
+    } else if (strcmp(operation, "search") == 0) {
+        for (int i = 0; i < n; i++)
+            bench_do_not_optimize(iavl_search(&tree, keys[i]));
+    } else {
+        for (int i = 0; i < n; i++)
+            iavl_delete(&tree, nodes[i]);
+    }
+    end = bench_now();
+    perf_counters_stop(pc);
+
+    struct avl_node *node;
+    while ((node = tree.avl_node) != NULL)
+        iavl_delete(&tree, avl_entry(node, struct my_avl_node, avl));
+    free(nodes);
+    return bench_ns_per_op(start, end, n);
+}
+
+// The B+tree maps each key to its slot in @keys, standing in for a record
+static double run_btree(const char* operation, const int* keys, int n, struct perf_counters* pc) {
+    struct btree tree = BTREE_INIT;
+    uint64_t start, end;
+
+    if (strcmp(operation, "insert") != 0) {
+        for (int i = 0; i < n; i++)
+            btree_insert(&tree, keys[i], (void*)&keys[i]);
+    }
+
+    perf_counters_start(pc);
+    start = bench_now();
+    if (strcmp(operation, "insert") == 0) {
+        for (int i = 0; i < n; i++)
+            btree_insert(&tree, keys[i], (void*)&keys[i]);
+    } else if (strcmp(operation, "search") == 0) {
+        for (int i = 0; i < n; i++)
+            bench_do_not_optimize(btree_lookup(&tree, keys[i]));
+    } else {
+        for (int i = 0; i < n; i++)
+            btree_remove(&tree, keys[i]);
+    }
+    end = bench_now();
+    perf_counters_stop(pc);
+
+    btree_destroy(&tree);
+    return bench_ns_per_op(start, end, n);
+}
+
+// Per-node memory: the tree links alone, the whole user node, and what
+// malloc and the node pool actually hand out for one node
+void measure_node_footprint(void) {
+    struct node_pool pool;
+    void *p;
+    FILE* file = fopen("node_footprint.dat", "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    fprintf(file, "# Tree LinkBytes NodeBytes MallocBytes PoolBytes\n");
+
+#define REPORT_FOOTPRINT(name, link, node) do {                          \
+        p = malloc(node);                                                   \
+        node_pool_init(&pool, node, 1);                                     \
+        fprintf(file, "%s %zu %zu %zu %zu\n", name, (size_t)(link),        \
+                (size_t)(node), malloc_usable_size(p), pool.size);          \
+        free(p);                                                            \
+        node_pool_destroy(&pool);                                           \
+    } while (0)
+
+    REPORT_FOOTPRINT("RBTree", sizeof(struct rb_node), sizeof(struct my_node));
+    REPORT_FOOTPRINT("AVLTree", sizeof(Node) - sizeof(Type), sizeof(Node));
+    REPORT_FOOTPRINT("IntrusiveAVL", sizeof(struct avl_node), sizeof(struct my_avl_node));
+#undef REPORT_FOOTPRINT
+
+    fclose(file);
+}
+
+// Tree variants in the order of the .dat columns
+enum {
+    RB_MALLOC, AVL_MALLOC, RB_POOL, AVL_POOL, IAVL_MALLOC, IAVL_POOL,
+    ITER_AVL_MALLOC, ITER_AVL_POOL, BTREE, NR_VARIANTS
+};
+
+static const char* variant_names[NR_VARIANTS] = {
+    "RBTree", "AVLTree", "RBTreePool", "AVLTreePool", "IntrusiveAVL", "IntrusiveAVLPool",
+    "IterativeAVL", "IterativeAVLPool", "BTree"
+};
+
+#define WARMUP_ITERATIONS 2
+
 void measure_performance(const char* operation, int max_node_count, int step_size, int iterations) {
     char time_data_file[256];
     sprintf(time_data_file, "%s_time.dat", operation);
@@ -166,93 +458,1029 @@ void measure_performance(const char* operation, int max_node_count, int step_siz
         perror("Error opening file for writing");
         return;
     }
-    fprintf(time_file, "# NodeCount RBTreeTime AVLTreeTime\n");
+    // Median ns/op of each variant, then the 95% confidence half-widths of their means
+    fprintf(time_file, "# NodeCount RBTreeTime AVLTreeTime RBTreePoolTime AVLTreePoolTime IntrusiveAVLTime IntrusiveAVLPoolTime IterativeAVLTime IterativeAVLPoolTime BTreeTime");
+    fprintf(time_file, " RBTreeCI AVLTreeCI RBTreePoolCI AVLTreePoolCI IntrusiveAVLCI IntrusiveAVLPoolCI IterativeAVLCI IterativeAVLPoolCI BTreeCI\n");
+
+    // Hardware counters per operation, counted around the timed batches
+    char counters_data_file[256];
+    sprintf(counters_data_file, "%s_counters.dat", operation);
+    FILE* counters_file = fopen(counters_data_file, "w");
+    if (!counters_file) {
+        perror("Error opening file for writing");
+        fclose(time_file);
+        return;
+    }
+    fprintf(counters_file, "# NodeCount Tree CacheMisses LLCLoads DTLBMisses BranchMisses Instructions\n");
+
+    struct perf_counters pc[NR_VARIANTS];
+    int opened = 0;
+    for (int v = 0; v < NR_VARIANTS; v++)
+        opened += perf_counters_open(&pc[v]);
+    if (!opened)
+        fprintf(stderr, "perf_event_open unavailable, hardware counters are reported as -1\n");
+
+    node_pool_init(&rb_pool, sizeof(struct my_node), 4096);
+    node_pool_init(&avl_pool, sizeof(Node), 4096);
+    node_pool_init(&iavl_pool, sizeof(struct my_avl_node), 4096);
+
+    double* samples[NR_VARIANTS];
+    for (int v = 0; v < NR_VARIANTS; v++)
+        samples[v] = malloc(iterations * sizeof(double));
 
     for (int n = step_size; n <= max_node_count; n += step_size) {
-        double total_rb_time = 0.0, total_avl_time = 0.0;
+        struct bench_stats stats[NR_VARIANTS];
+        int* keys = (int*)malloc(n * sizeof(int));
 
-        for (int iter = 0; iter < iterations; iter++) {
-            struct rb_root rb_tree = RB_ROOT;
-            AVLTree avl_tree = NULL;
+        // The first WARMUP_ITERATIONS rounds only warm caches and the pools
+        for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+            double t[NR_VARIANTS];
 
-            int* keys = (int*)malloc(n * sizeof(int));
             generate_unique_random_keys(keys, n);
+            // Counters only cover the recorded iterations
+            if (iter == 0)
+                for (int v = 0; v < NR_VARIANTS; v++)
+                    perf_counters_clear(&pc[v]);
+
+            // Allocation is timed with the tree operation
+            for (int pool = 0; pool < 2; pool++) {
+                set_node_allocator(pool);
+                int rb = pool ? RB_POOL : RB_MALLOC, avl = pool ? AVL_POOL : AVL_MALLOC;
+                int iter_avl = pool ? ITER_AVL_POOL : ITER_AVL_MALLOC, iavl = pool ? IAVL_POOL : IAVL_MALLOC;
 
-            clock_t start, end;
-
-            if (strcmp(operation, "insert") == 0) {
-                // Measure Insert
-                for (int i = 0; i < n; i++) {
-                    // RB Tree
-                    struct my_node* new_node = malloc(sizeof(struct my_node));
-                    new_node->key = keys[i];
-                    start = clock();
-                    rb_insert(&rb_tree, new_node);
-                    end = clock();
-                    total_rb_time += get_time_in_seconds(start, end);
-
-                    // AVL Tree
-                    start = clock();
-                    avl_tree = avl_insert(avl_tree, keys[i]);
-                    end = clock();
-                    total_avl_time += get_time_in_seconds(start, end);
+                t[rb] = run_rbtree(operation, keys, n, &pc[rb]);
+                t[avl] = run_avltree(operation, keys, n, 0, &pc[avl]);
+                t[iter_avl] = run_avltree(operation, keys, n, 1, &pc[iter_avl]);
+                t[iavl] = run_intrusive_avl(operation, keys, n, &pc[iavl]);
+                // The B+tree allocates its own cache-line aligned nodes
+                if (!pool)
+                    t[BTREE] = run_btree(operation, keys, n, &pc[BTREE]);
+                if (pool) {
+                    node_pool_free_all(&rb_pool);
+                    node_pool_free_all(&avl_pool);
+                    node_pool_free_all(&iavl_pool);
                 }
-            } else if (strcmp(operation, "search") == 0) {
-                // Insert nodes first
-                for (int i = 0; i < n; i++) {
-                    struct my_node* new_node = malloc(sizeof(struct my_node));
-                    new_node->key = keys[i];
-                    rb_insert(&rb_tree, new_node);
-                    avl_tree = avl_insert(avl_tree, keys[i]);
+            }
+
+            if (iter >= 0)
+                for (int v = 0; v < NR_VARIANTS; v++)
+                    samples[v][iter] = t[v];
+        }
+        free(keys);
+
+        fprintf(time_file, "%d", n);
+        for (int v = 0; v < NR_VARIANTS; v++) {
+            bench_summarize(samples[v], iterations, &stats[v]);
+            fprintf(time_file, " %f", stats[v].median);
+            results_add(operation, variant_names[v], "shuffled", n, &stats[v]);
+        }
+        for (int v = 0; v < NR_VARIANTS; v++)
+            fprintf(time_file, " %f", stats[v].ci95);
+        fprintf(time_file, "\n");
+
+        for (int v = 0; v < NR_VARIANTS; v++)
+            print_counters(counters_file, n, variant_names[v], &pc[v], (long)n * iterations);
+    }
+
+    for (int v = 0; v < NR_VARIANTS; v++) {
+        free(samples[v]);
+        perf_counters_close(&pc[v]);
+    }
+    set_node_allocator(0);
+    node_pool_destroy(&rb_pool);
+    node_pool_destroy(&avl_pool);
+    node_pool_destroy(&iavl_pool);
+    fclose(time_file);
+    fclose(counters_file);
+}
+
+// Workload replay: load @records keys in @load order, then time the mixed
+// operation stream (ops[i] on keys[i]) as one batch; returns ns/op.
+static double replay_rbtree(const int* load, long records, const unsigned char* ops, const int* keys, long n_ops) {
+    struct rb_root tree = RB_ROOT;
+    uint64_t start, end;
+
+    for (long i = 0; i < records; i++) {
+        struct my_node* data = alloc_my_node();
+        data->key = load[i];
+        rb_insert(&tree, data);
+    }
+
+    start = bench_now();
+    for (long i = 0; i < n_ops; i++) {
+        struct rb_node* node;
+
+        if (ops[i] == WORKLOAD_READ) {
+            bench_do_not_optimize(rb_search(&tree, keys[i]));
+        } else if (ops[i] == WORKLOAD_INSERT) {
+            struct my_node* data = alloc_my_node();
+            data->key = keys[i];
+            if (!rb_insert(&tree, data))
+                free_my_node(data);
+        } else if ((node = rb_search(&tree, keys[i])) != NULL) {
+            rb_delete(&tree, rb_entry(node, struct my_node, rb));
+        }
+    }
+    end = bench_now();
+
+    struct rb_node *node;
+    while ((node = tree.rb_node) != NULL)
+        rb_delete(&tree, rb_entry(node, struct my_node, rb));
+    return bench_ns_per_op(start, end, n_ops);
+}
+
+static double replay_avltree(const int* load, long records, const unsigned char* ops, const int* keys, long n_ops, int iterative) {
+    Node* (*insert)(AVLTree, int) = iterative ? avl_insert_iterative : avl_insert;
+    Node* (*delete)(AVLTree, int) = iterative ? avl_delete_iterative : avl_delete;
+    AVLTree tree = NULL;
+    uint64_t start, end;
+
+    for (long i = 0; i < records; i++)
+        tree = insert(tree, load[i]);
+
+    start = bench_now();
+    for (long i = 0; i < n_ops; i++) {
+        if (ops[i] == WORKLOAD_READ)
+            bench_do_not_optimize(avl_search(tree, keys[i]));
+        else if (ops[i] == WORKLOAD_INSERT)
+            tree = insert(tree, keys[i]);
+        else
+            tree = delete(tree, keys[i]);
+    }
+    end = bench_now();
+
+    destroy_avltree(tree);
+    return bench_ns_per_op(start, end, n_ops);
+}
+
+static double replay_intrusive_avl(const int* load, long records, const unsigned char* ops, const int* keys, long n_ops) {
+    struct avl_root tree = AVL_ROOT;
+    uint64_t start, end;
+
+    for (long i = 0; i < records; i++) {
+        struct my_avl_node* data = alloc_my_avl_node();
+        data->key = load[i];
+        iavl_insert(&tree, data);
+    }
+
+    start = bench_now();
+    for (long i = 0; i < n_ops; i++) {
+        struct avl_node* node;
+
+        if (ops[i] == WORKLOAD_READ) {
+            bench_do_not_optimize(iavl_search(&tree, keys[i]));
+        } else if (ops[i] == WORKLOAD_INSERT) {
+            struct my_avl_node* data = alloc_my_avl_node();
+            data->key = keys[i];
+            if (!iavl_insert(&tree, data))
+                free_my_avl_node(data);
+        } else if ((node = iavl_search(&tree, keys[i])) != NULL) {
+            iavl_delete(&tree, avl_entry(node, struct my_avl_node, avl));
+        }
+    }
+    end = bench_now();
+
+    struct avl_node *node;
+    while ((node = tree.avl_node) != NULL)
+        iavl_delete(&tree, avl_entry(node, struct my_avl_node, avl));
+    return bench_ns_per_op(start, end, n_ops);
+}
+
+static double replay_btree(const int* load, long records, const unsigned char* ops, const int* keys, long n_ops) {
+    struct btree tree = BTREE_INIT;
+    uint64_t start, end;
+
+    for (long i = 0; i < records; i++)
+        btree_insert(&tree, load[i], (void*)&load[i]);
+
+    start = bench_now();
+    for (long i = 0; i < n_ops; i++) {
+        if (ops[i] == WORKLOAD_READ)
+            bench_do_not_optimize(btree_lookup(&tree, keys[i]));
+        else if (ops[i] == WORKLOAD_INSERT)
+            btree_insert(&tree, keys[i], (void*)&keys[i]);
+        else
+            btree_remove(&tree, keys[i]);
+    }
+    end = bench_now();
+
+    btree_destroy(&tree);
+    return bench_ns_per_op(start, end, n_ops);
+}
+
+// Mixed read/insert/delete streams over every key distribution; the same
+// seeded stream is replayed against each tree
+void measure_workloads(long records, long n_ops, int iterations) {
+    static const char* mixes[] = { "100/0/0", "95/5/0", "90/5/5", "50/25/25" };
+    enum { W_RB, W_AVL, W_ITER_AVL, W_IAVL, W_BTREE, NR_WORKLOAD_TREES };
+    static const char* workload_tree_names[NR_WORKLOAD_TREES] = { "RBTree", "AVLTree", "IterativeAVL", "IntrusiveAVL", "BTree" };
+
+    FILE* file = fopen("workload_time.dat", "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    // Median ns/op of each tree, then the 95% confidence half-widths of their means
+    fprintf(file, "# Distribution Mix RBTree AVLTree IterativeAVL IntrusiveAVL BTree RBTreeCI AVLTreeCI IterativeAVLCI IntrusiveAVLCI BTreeCI\n");
+
+    int* load = malloc(records * sizeof(int));
+    int* keys = malloc(n_ops * sizeof(int));
+    unsigned char* ops = malloc(n_ops);
+    double* samples[NR_WORKLOAD_TREES];
+    for (int t = 0; t < NR_WORKLOAD_TREES; t++)
+        samples[t] = malloc(iterations * sizeof(double));
+
+    set_node_allocator(0);
+    for (int dist = 0; dist < WORKLOAD_NR_DISTS; dist++) {
+        for (size_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); m++) {
+            struct bench_stats stats[NR_WORKLOAD_TREES];
+            struct workload_mix mix;
+            struct workload wl;
+
+            workload_parse_mix(mixes[m], &mix);
+            workload_init(&wl, dist, &mix, records, 42);
+            workload_load_keys(&wl, load);
+            for (long i = 0; i < n_ops; i++)
+                ops[i] = workload_next(&wl, &keys[i]);
+
+            for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+                double t[NR_WORKLOAD_TREES];
+
+                t[W_RB] = replay_rbtree(load, records, ops, keys, n_ops);
+                t[W_AVL] = replay_avltree(load, records, ops, keys, n_ops, 0);
+                t[W_ITER_AVL] = replay_avltree(load, records, ops, keys, n_ops, 1);
+                t[W_IAVL] = replay_intrusive_avl(load, records, ops, keys, n_ops);
+                t[W_BTREE] = replay_btree(load, records, ops, keys, n_ops);
+                if (iter >= 0)
+                    for (int v = 0; v < NR_WORKLOAD_TREES; v++)
+                        samples[v][iter] = t[v];
+            }
+
+            char workload_name[64];
+            snprintf(workload_name, sizeof(workload_name), "%s %s", workload_dist_names[dist], mixes[m]);
+
+            fprintf(file, "%s %s", workload_dist_names[dist], mixes[m]);
+            for (int v = 0; v < NR_WORKLOAD_TREES; v++) {
+                bench_summarize(samples[v], iterations, &stats[v]);
+                fprintf(file, " %f", stats[v].median);
+                results_add("workload", workload_tree_names[v], workload_name, records, &stats[v]);
+            }
+            for (int v = 0; v < NR_WORKLOAD_TREES; v++)
+                fprintf(file, " %f", stats[v].ci95);
+            fprintf(file, "\n");
+        }
+    }
+
+    for (int t = 0; t < NR_WORKLOAD_TREES; t++)
+        free(samples[t]);
+    free(ops);
+    free(keys);
+    free(load);
+    fclose(file);
+}
+
+// Which level of the memory hierarchy a working set of @bytes fits in
+static const char* cache_regime(double bytes) {
+    long l1 = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    long l3 = sysconf(_SC_LEVEL3_CACHE_SIZE);
+
+    if (l1 <= 0 && l2 <= 0 && l3 <= 0)
+        return "unknown";
+    if (l1 > 0 && bytes <= l1)
+        return "L1";
+    if (l2 > 0 && bytes <= l2)
+        return "L2";
+    if (l3 > 0 && bytes <= l3)
+        return "LLC";
+    return "DRAM";
+}
+
+// Lookups timed per size; random probes, so a sample stands for all n keys
+#define SCALING_LOOKUPS (1 << 20)
+
+// One build of an n-node tree: ns per insert and per lookup, the bytes of
+// its nodes, and how much the resident set grew while building
+struct scaling_sample {
+    double insert_ns, search_ns;
+    size_t footprint;
+    long rss_kb;
+};
+
+static void scale_rbtree(const int* keys, int n, const int* probes, int n_probes, struct scaling_sample* r) {
+    struct rb_root tree = RB_ROOT;
+    long rss = get_memory_usage();
+    uint64_t start, end;
+
+    start = bench_now();
+    for (int i = 0; i < n; i++) {
+        struct my_node* data = alloc_my_node();
+        data->key = keys[i];
+        rb_insert(&tree, data);
+    }
+    end = bench_now();
+    r->insert_ns = bench_ns_per_op(start, end, n);
+    r->rss_kb = get_memory_usage() - rss;
+    r->footprint = n * sizeof(struct my_node);
+
+    start = bench_now();
+    for (int i = 0; i < n_probes; i++)
+        bench_do_not_optimize(rb_search(&tree, probes[i]));
+    end = bench_now();
+    r->search_ns = bench_ns_per_op(start, end, n_probes);
+
+    struct rb_node *node;
+    while ((node = tree.rb_node) != NULL)
+        rb_delete(&tree, rb_entry(node, struct my_node, rb));
+}
+
+static void scale_avltree(const int* keys, int n, const int* probes, int n_probes, struct scaling_sample* r) {
+    AVLTree tree = NULL;
+    long rss = get_memory_usage();
+    uint64_t start, end;
+
+    start = bench_now();
+    for (int i = 0; i < n; i++)
+        tree = avl_insert_iterative(tree, keys[i]);
+    end = bench_now();
+    r->insert_ns = bench_ns_per_op(start, end, n);
+    r->rss_kb = get_memory_usage() - rss;
+    r->footprint = n * sizeof(Node);
+
+    start = bench_now();
+    for (int i = 0; i < n_probes; i++)
+        bench_do_not_optimize(avl_search(tree, probes[i]));
+    end = bench_now();
+    r->search_ns = bench_ns_per_op(start, end, n_probes);
+
+    destroy_avltree(tree);
+}
+
+static void scale_intrusive_avl(const int* keys, int n, const int* probes, int n_probes, struct scaling_sample* r) {
+    struct avl_root tree = AVL_ROOT;
+    long rss = get_memory_usage();
+    uint64_t start, end;
+
+    start = bench_now();
+    for (int i = 0; i < n; i++) {
+        struct my_avl_node* data = alloc_my_avl_node();
+        data->key = keys[i];
+        iavl_insert(&tree, data);
+    }
+    end = bench_now();
+    r->insert_ns = bench_ns_per_op(start, end, n);
+    r->rss_kb = get_memory_usage() - rss;
+    r->footprint = n * sizeof(struct my_avl_node);
+
+    start = bench_now();
+    for (int i = 0; i < n_probes; i++)
+        bench_do_not_optimize(iavl_search(&tree, probes[i]));
+    end = bench_now();
+    r->search_ns = bench_ns_per_op(start, end, n_probes);
+
+    struct avl_node *node;
+    while ((node = tree.avl_node) != NULL)
+        iavl_delete(&tree, avl_entry(node, struct my_avl_node, avl));
+}
+
+static void scale_btree(const int* keys, int n, const int* probes, int n_probes, struct scaling_sample* r) {
+    struct btree tree = BTREE_INIT;
+    long rss = get_memory_usage();
+    uint64_t start, end;
+
+    start = bench_now();
+    for (int i = 0; i < n; i++)
+        btree_insert(&tree, keys[i], (void*)&keys[i]);
+    end = bench_now();
+    r->insert_ns = bench_ns_per_op(start, end, n);
+    r->rss_kb = get_memory_usage() - rss;
+    r->footprint = btree_node_count(&tree) * sizeof(struct btree_node);
+
+    start = bench_now();
+    for (int i = 0; i < n_probes; i++)
+        bench_do_not_optimize(btree_lookup(&tree, probes[i]));
+    end = bench_now();
+    r->search_ns = bench_ns_per_op(start, end, n_probes);
+
+    btree_destroy(&tree);
+}
+
+// Geometric sweep of the tree size from @min_nodes to @max_nodes, doubling
+// each step, through the L1/L2/LLC/DRAM regimes.  Nodes come from malloc,
+// and freed memory is returned to the kernel between builds so each RSS
+// delta covers one tree only.  The cache regime is judged from the node
+// sizes in node_footprint.dat times the node count, not from the RSS delta.
+void measure_scaling(int min_nodes, int max_nodes, int iterations) {
+    static const char* tree_names[] = { "RBTree", "AVLTree", "IntrusiveAVL", "BTree" };
+    void (*scale[])(const int*, int, const int*, int, struct scaling_sample*) = {
+        scale_rbtree, scale_avltree, scale_intrusive_avl, scale_btree
+    };
+    enum { NR_SCALING_TREES = 4 };
+
+    FILE* file = fopen("scaling.dat", "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    fprintf(file, "# NodeCount Tree Regime BytesPerNode RSSBytesPerNode RSSDeltaKB InsertTime SearchTime InsertCI SearchCI\n");
+
+    double* insert_samples = malloc(iterations * sizeof(double));
+    double* search_samples = malloc(iterations * sizeof(double));
+    int* probes = malloc(SCALING_LOOKUPS * sizeof(int));
+
+    set_node_allocator(0);
+    for (long n = min_nodes; n <= max_nodes; n *= 2) {
+        int* keys = malloc(n * sizeof(int));
+        int n_probes = n < SCALING_LOOKUPS ? n : SCALING_LOOKUPS;
+        // Builds past a million nodes take seconds: one round, no warm-up
+        int reps = n <= (1 << 20) ? iterations : 1;
+        int warmup = reps > 1 ? WARMUP_ITERATIONS : 0;
+
+        generate_unique_random_keys(keys, n);
+        for (int i = 0; i < n_probes; i++)
+            probes[i] = rand() % n;
+
+        for (int t = 0; t < NR_SCALING_TREES; t++) {
+            struct bench_stats insert_stats, search_stats;
+            struct scaling_sample sample = { 0 };
+
+            for (int iter = -warmup; iter < reps; iter++) {
+                scale[t](keys, n, probes, n_probes, &sample);
+                malloc_trim(0);
+                if (iter >= 0) {
+                    insert_samples[iter] = sample.insert_ns;
+                    search_samples[iter] = sample.search_ns;
                 }
-                // Measure Search
-                for (int i = 0; i < n; i++) {
-                    // RB Tree
-                    start = clock();
-                    rb_search(&rb_tree, keys[i]);
-                    end = clock();
-                    total_rb_time += get_time_in_seconds(start, end);
-
-                    // AVL Tree
-                    start = clock();
-                    avl_search(avl_tree, keys[i]);
-                    end = clock();
-                    total_avl_time += get_time_in_seconds(start, end);
+            }
+            bench_summarize(insert_samples, reps, &insert_stats);
+            bench_summarize(search_samples, reps, &search_stats);
+            results_add("scaling-insert", tree_names[t], "shuffled", n, &insert_stats);
+            results_add("scaling-search", tree_names[t], "uniform", n, &search_stats);
+
+            // The RSS delta is page granular, and often 0 for small trees,
+            // so the regime follows from the size of the nodes themselves
+            fprintf(file, "%ld %s %s %f %f %ld %f %f %f %f\n", n, tree_names[t],
+                    cache_regime(sample.footprint), (double)sample.footprint / n,
+                    sample.rss_kb * 1024.0 / n, sample.rss_kb,
+                    insert_stats.median, search_stats.median, insert_stats.ci95, search_stats.ci95);
+            fflush(file);
+        }
+        free(keys);
+    }
+
+    free(probes);
+    free(search_samples);
+    free(insert_samples);
+    fclose(file);
+}
+
+// Bulk loading sorted keys: one insert per key (every one lands on the
+// rightmost path and rebalances) against the O(n) sorted builds; ns per node
+void measure_bulk_load(int min_nodes, int max_nodes, int iterations) {
+    enum { RB_INSERT, RB_BULK, AVL_INSERT, AVL_BULK, NR_BULK };
+    static const char* names[NR_BULK] = { "RBTree", "RBTreeBulk", "AVLTree", "AVLTreeBulk" };
+
+    FILE* file = fopen("bulk_load.dat", "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    fprintf(file, "# NodeCount RBInsertTime RBBulkTime AVLInsertTime AVLBulkTime RBInsertCI RBBulkCI AVLInsertCI AVLBulkCI\n");
+
+    double* samples[NR_BULK];
+    for (int v = 0; v < NR_BULK; v++)
+        samples[v] = malloc(iterations * sizeof(double));
+
+    set_node_allocator(0);
+    for (int n = min_nodes; n <= max_nodes; n *= 4) {
+        struct my_node* nodes = malloc(n * sizeof(struct my_node));
+        struct rb_node** links = malloc(n * sizeof(struct rb_node*));
+        int* keys = malloc(n * sizeof(int));
+        struct bench_stats stats[NR_BULK];
+        uint64_t start, end;
+
+        for (int i = 0; i < n; i++) {
+            keys[i] = i;
+            nodes[i].key = i;
+            links[i] = &nodes[i].rb;
+        }
+
+        for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+            struct rb_root tree = RB_ROOT;
+            AVLTree avl;
+            double t[NR_BULK];
+
+            // The rbtree nodes are preallocated, so only linking is timed
+            start = bench_now();
+            for (int i = 0; i < n; i++)
+                rb_insert(&tree, &nodes[i]);
+            end = bench_now();
+            t[RB_INSERT] = bench_ns_per_op(start, end, n);
+
+            tree = RB_ROOT;
+            start = bench_now();
+            rb_build_sorted(links, n, &tree);
+            end = bench_now();
+            t[RB_BULK] = bench_ns_per_op(start, end, n);
+
+            // The AVL tree allocates its nodes either way
+            avl = NULL;
+            start = bench_now();
+            for (int i = 0; i < n; i++)
+                avl = avl_insert_iterative(avl, keys[i]);
+            end = bench_now();
+            t[AVL_INSERT] = bench_ns_per_op(start, end, n);
+            destroy_avltree(avl);
+
+            start = bench_now();
+            avl = avltree_build_sorted(keys, n);
+            end = bench_now();
+            t[AVL_BULK] = bench_ns_per_op(start, end, n);
+            destroy_avltree(avl);
+
+            if (iter >= 0)
+                for (int v = 0; v < NR_BULK; v++)
+                    samples[v][iter] = t[v];
+        }
+
+        fprintf(file, "%d", n);
+        for (int v = 0; v < NR_BULK; v++) {
+            bench_summarize(samples[v], iterations, &stats[v]);
+            fprintf(file, " %f", stats[v].median);
+            results_add("bulk-load", names[v], "sequential", n, &stats[v]);
+        }
+        for (int v = 0; v < NR_BULK; v++)
+            fprintf(file, " %f", stats[v].ci95);
+        fprintf(file, "\n");
+
+        free(keys);
+        free(links);
+        free(nodes);
+    }
+
+    for (int v = 0; v < NR_BULK; v++)
+        free(samples[v]);
+    fclose(file);
+}
+
+// Lookups in the branchy rbtree descent against the B+tree with each of
+// its in-node search kernels.  Kernels the CPU lacks are left out (nan).
+void measure_node_search(int min_nodes, int max_nodes, int iterations) {
+    enum { NS_RB, NS_SCALAR, NS_SSE2, NS_AVX2, NR_NODE_SEARCH };
+    static const char* names[NR_NODE_SEARCH] = { "RBTree", "BTreeScalar", "BTreeSSE2", "BTreeAVX2" };
+    static const enum btree_search kernels[NR_NODE_SEARCH] = {
+        0, BTREE_SEARCH_SCALAR, BTREE_SEARCH_SSE2, BTREE_SEARCH_AVX2
+    };
+
+    FILE* file = fopen("node_search.dat", "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    fprintf(file, "# NodeCount RBTree BTreeScalar BTreeSSE2 BTreeAVX2 RBTreeCI BTreeScalarCI BTreeSSE2CI BTreeAVX2CI\n");
+
+    double* samples = malloc(iterations * sizeof(double));
+    int* probes = malloc(SCALING_LOOKUPS * sizeof(int));
+
+    set_node_allocator(0);
+    for (int n = min_nodes; n <= max_nodes; n *= 4) {
+        struct my_node* nodes = malloc(n * sizeof(struct my_node));
+        int* keys = malloc(n * sizeof(int));
+        struct rb_root rb = RB_ROOT;
+        struct btree bt = BTREE_INIT;
+        struct bench_stats stats[NR_NODE_SEARCH];
+        uint64_t start, end;
+
+        generate_unique_random_keys(keys, n);
+        for (int i = 0; i < n; i++) {
+            nodes[i].key = keys[i];
+            rb_insert(&rb, &nodes[i]);
+            btree_insert(&bt, keys[i], &nodes[i]);
+        }
+        for (int i = 0; i < SCALING_LOOKUPS; i++)
+            probes[i] = keys[rand() % n];
+
+        for (int v = 0; v < NR_NODE_SEARCH; v++) {
+            if (v != NS_RB && btree_set_search(kernels[v])) {
+                stats[v].median = stats[v].ci95 = NAN;
+                continue;
+            }
+            for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+                start = bench_now();
+                if (v == NS_RB) {
+                    for (int i = 0; i < SCALING_LOOKUPS; i++)
+                        bench_do_not_optimize(rb_search(&rb, probes[i]));
+                } else {
+                    for (int i = 0; i < SCALING_LOOKUPS; i++)
+                        bench_do_not_optimize(btree_lookup(&bt, probes[i]));
                 }
-            } else if (strcmp(operation, "delete") == 0) {
-                // Insert nodes first
-                for (int i = 0; i < n; i++) {
-                    struct my_node* new_node = malloc(sizeof(struct my_node));
-                    new_node->key = keys[i];
-                    rb_insert(&rb_tree, new_node);
-                    avl_tree = avl_insert(avl_tree, keys[i]);
+                end = bench_now();
+                if (iter >= 0)
+                    samples[iter] = bench_ns_per_op(start, end, SCALING_LOOKUPS);
+            }
+            bench_summarize(samples, iterations, &stats[v]);
+            results_add("node-search", names[v], "shuffled", n, &stats[v]);
+        }
+        btree_set_search(BTREE_SEARCH_AUTO);
+
+        fprintf(file, "%d", n);
+        for (int v = 0; v < NR_NODE_SEARCH; v++)
+            fprintf(file, " %f", stats[v].median);
+        for (int v = 0; v < NR_NODE_SEARCH; v++)
+            fprintf(file, " %f", stats[v].ci95);
+        fprintf(file, "\n");
+
+        btree_destroy(&bt);
+        free(keys);
+        free(nodes);
+    }
+
+    free(probes);
+    free(samples);
+    fclose(file);
+}
+
+static int my_key_cmp(const void *key, const struct rb_node *node) {
+    int k = *(const int*)key, nk = rb_entry(node, struct my_node, rb)->key;
+    return (k > nk) - (k < nk);
+}
+
+// One-at-a-time lookups against the interleaved batch descents, at sizes
+// from LLC to DRAM resident, where every level of a descent misses
+void measure_batch_lookup(int min_nodes, int max_nodes, int iterations) {
+    enum { B_RB, B_RB_BATCH, B_AVL, B_AVL_BATCH, NR_BATCH };
+    static const char* names[NR_BATCH] = { "RBTree", "RBTreeBatch", "AVLTree", "AVLTreeBatch" };
+
+    FILE* file = fopen("batch_lookup.dat", "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    fprintf(file, "# NodeCount RBTree RBTreeBatch AVLTree AVLTreeBatch RBTreeCI RBTreeBatchCI AVLTreeCI AVLTreeBatchCI\n");
+
+    double* samples[NR_BATCH];
+    for (int v = 0; v < NR_BATCH; v++)
+        samples[v] = malloc(iterations * sizeof(double));
+    int* probes = malloc(SCALING_LOOKUPS * sizeof(int));
+    const void** probe_keys = malloc(SCALING_LOOKUPS * sizeof(void*));
+    struct rb_node** found = malloc(SCALING_LOOKUPS * sizeof(struct rb_node*));
+    Node** avl_found = malloc(SCALING_LOOKUPS * sizeof(Node*));
+
+    set_node_allocator(0);
+    for (int n = min_nodes; n <= max_nodes; n *= 4) {
+        struct my_node* nodes = malloc(n * sizeof(struct my_node));
+        int* keys = malloc(n * sizeof(int));
+        struct rb_root rb = RB_ROOT;
+        AVLTree avl = NULL;
+        struct bench_stats stats[NR_BATCH];
+        uint64_t start, end;
+
+        generate_unique_random_keys(keys, n);
+        for (int i = 0; i < n; i++) {
+            nodes[i].key = keys[i];
+            rb_insert(&rb, &nodes[i]);
+            avl = avl_insert_iterative(avl, keys[i]);
+        }
+        for (int i = 0; i < SCALING_LOOKUPS; i++) {
+            probes[i] = keys[rand() % n];
+            probe_keys[i] = &probes[i];
+        }
+
+        for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+            double t[NR_BATCH];
+
+            start = bench_now();
+            for (int i = 0; i < SCALING_LOOKUPS; i++)
+                bench_do_not_optimize(rb_find(probe_keys[i], &rb, my_key_cmp));
+            end = bench_now();
+            t[B_RB] = bench_ns_per_op(start, end, SCALING_LOOKUPS);
+
+            start = bench_now();
+            rb_find_batch(probe_keys, found, SCALING_LOOKUPS, &rb, my_key_cmp);
+            end = bench_now();
+            bench_do_not_optimize(found[SCALING_LOOKUPS - 1]);
+            t[B_RB_BATCH] = bench_ns_per_op(start, end, SCALING_LOOKUPS);
+
+            start = bench_now();
+            for (int i = 0; i < SCALING_LOOKUPS; i++)
+                bench_do_not_optimize(iterative_avltree_search(avl, probes[i]));
+            end = bench_now();
+            t[B_AVL] = bench_ns_per_op(start, end, SCALING_LOOKUPS);
+
+            start = bench_now();
+            avltree_search_batch(avl, probes, avl_found, SCALING_LOOKUPS);
+            end = bench_now();
+            bench_do_not_optimize(avl_found[SCALING_LOOKUPS - 1]);
+            t[B_AVL_BATCH] = bench_ns_per_op(start, end, SCALING_LOOKUPS);
+
+            if (iter >= 0)
+                for (int v = 0; v < NR_BATCH; v++)
+                    samples[v][iter] = t[v];
+        }
+
+        fprintf(file, "%d", n);
+        for (int v = 0; v < NR_BATCH; v++) {
+            bench_summarize(samples[v], iterations, &stats[v]);
+            fprintf(file, " %f", stats[v].median);
+            results_add("batch-lookup", names[v], "shuffled", n, &stats[v]);
+        }
+        for (int v = 0; v < NR_BATCH; v++)
+            fprintf(file, " %f", stats[v].ci95);
+        fprintf(file, "\n");
+
+        destroy_avltree(avl);
+        free(keys);
+        free(nodes);
+    }
+
+    free(avl_found);
+    free(found);
+    free(probe_keys);
+    free(probes);
+    for (int v = 0; v < NR_BATCH; v++)
+        free(samples[v]);
+    fclose(file);
+}
+
+// The same entry linked by 32-bit indices instead of pointers
+struct my_node32 {
+    int key;
+    struct rb32_node rb;
+};
+
+static uint32_t rb32_search(struct rb32_root *root, int key) {
+    uint32_t node = root->rb_node;
+    rb_comparison_count = 0;
+
+    while (node) {
+        rb_comparison_count++;
+        struct my_node32 *data = rb32_entry(root, node, struct my_node32, rb);
+
+        if (key < data->key)
+            node = rb32_node(root, node)->rb_left;
+        else if (key > data->key)
+            node = rb32_node(root, node)->rb_right;
+        else
+            return node;
+    }
+    return RB32_NIL;
+}
+
+static void rb32_insert(struct rb32_root *root, uint32_t idx) {
+    uint32_t *link = &root->rb_node, parent = RB32_NIL;
+    int key = rb32_entry(root, idx, struct my_node32, rb)->key;
+    rb_comparison_count = 0;
+
+    while (*link) {
+        rb_comparison_count++;
+        parent = *link;
+        if (key < rb32_entry(root, parent, struct my_node32, rb)->key)
+            link = &rb32_node(root, parent)->rb_left;
+        else
+            link = &rb32_node(root, parent)->rb_right;
+    }
+    rb32_link_node(root, idx, parent, link);
+    rb32_insert_color(idx, root);
+}
+
+// Pointer-linked vs index-linked rbtrees, both with their entries in one
+// array and the same comparison-counting descents, so that only the link
+// size differs: ns per insert, search and erase
+void measure_rbtree32(int min_nodes, int max_nodes, int iterations) {
+    enum { RB_INSERT, RB32_INSERT, RB_SEARCH, RB32_SEARCH, RB_ERASE, RB32_ERASE, NR_RB32 };
+    static const char* benchmarks[NR_RB32] = {
+        "link-insert", "link-insert", "link-search", "link-search", "link-erase", "link-erase"
+    };
+    static const char* names[NR_RB32] = { "RBTree", "RBTree32", "RBTree", "RBTree32", "RBTree", "RBTree32" };
+
+    FILE* file = fopen("rbtree32_time.dat", "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    fprintf(file, "# NodeCount RBEntryBytes RB32EntryBytes RBInsertTime RB32InsertTime RBSearchTime RB32SearchTime "
+                  "RBEraseTime RB32EraseTime RBInsertCI RB32InsertCI RBSearchCI RB32SearchCI RBEraseCI RB32EraseCI\n");
+
+    double* samples[NR_RB32];
+    for (int v = 0; v < NR_RB32; v++)
+        samples[v] = malloc(iterations * sizeof(double));
+
+    for (int n = min_nodes; n <= max_nodes; n *= 4) {
+        struct my_node* nodes = malloc(n * sizeof(struct my_node));
+        // Index 0 is RB32_NIL, so entry i of the tree is nodes32[i + 1]
+        struct my_node32* nodes32 = malloc((n + 1) * sizeof(struct my_node32));
+        int* keys = malloc(n * sizeof(int));
+        struct bench_stats stats[NR_RB32];
+        uint64_t start, end;
+
+        generate_unique_random_keys(keys, n);
+        for (int i = 0; i < n; i++) {
+            nodes[i].key = keys[i];
+            nodes32[i + 1].key = keys[i];
+        }
+
+        for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+            struct rb_root tree = RB_ROOT;
+            struct rb32_root tree32 = RB32_ROOT(nodes32, struct my_node32, rb);
+            double t[NR_RB32];
+
+            start = bench_now();
+            for (int i = 0; i < n; i++)
+                rb_insert(&tree, &nodes[i]);
+            end = bench_now();
+            t[RB_INSERT] = bench_ns_per_op(start, end, n);
+
+            start = bench_now();
+            for (int i = 0; i < n; i++)
+                rb32_insert(&tree32, i + 1);
+            end = bench_now();
+            t[RB32_INSERT] = bench_ns_per_op(start, end, n);
+
+            start = bench_now();
+            for (int i = 0; i < n; i++)
+                bench_do_not_optimize(rb_search(&tree, keys[i]));
+            end = bench_now();
+            t[RB_SEARCH] = bench_ns_per_op(start, end, n);
+
+            start = bench_now();
+            for (int i = 0; i < n; i++)
+                bench_do_not_optimize(rb32_search(&tree32, keys[i]));
+            end = bench_now();
+            t[RB32_SEARCH] = bench_ns_per_op(start, end, n);
+
+            start = bench_now();
+            for (int i = 0; i < n; i++)
+                rb_erase(&nodes[i].rb, &tree);
+            end = bench_now();
+            t[RB_ERASE] = bench_ns_per_op(start, end, n);
+
+            start = bench_now();
+            for (int i = 0; i < n; i++)
+                rb32_erase(i + 1, &tree32);
+            end = bench_now();
+            t[RB32_ERASE] = bench_ns_per_op(start, end, n);
+
+            if (iter >= 0)
+                for (int v = 0; v < NR_RB32; v++)
+                    samples[v][iter] = t[v];
+        }
+
+        fprintf(file, "%d %zu %zu", n, sizeof(struct my_node), sizeof(struct my_node32));
+        for (int v = 0; v < NR_RB32; v++) {
+            bench_summarize(samples[v], iterations, &stats[v]);
+            fprintf(file, " %f", stats[v].median);
+            results_add(benchmarks[v], names[v], "shuffled", n, &stats[v]);
+        }
+        for (int v = 0; v < NR_RB32; v++)
+            fprintf(file, " %f", stats[v].ci95);
+        fprintf(file, "\n");
+
+        free(keys);
+        free(nodes32);
+        free(nodes);
+    }
+
+    for (int v = 0; v < NR_RB32; v++)
+        free(samples[v]);
+    fclose(file);
+}
+
+static int my_node_cmp(const struct rb_node *a, const struct rb_node *b) {
+    int ka = rb_entry(a, struct my_node, rb)->key, kb = rb_entry(b, struct my_node, rb)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+static void link_sorted(struct rb_node** links, struct my_node* nodes, int n) {
+    for (int i = 0; i < n; i++)
+        links[i] = &nodes[i].rb;
+}
+
+// 1, 2, 4, ... threads, ending with max_threads itself
+static int next_thread_count(int threads, int max_threads) {
+    return threads < max_threads && threads * 2 > max_threads ? max_threads : threads * 2;
+}
+
+// Bulk build of n keys, and union/difference of an n-key tree with an n/4-key
+// one, on thread pools of 1 to max_threads workers.  Times are ns per key
+// of the inputs; the speedup columns compare against one thread.
+void measure_parallel(int n, int max_threads, int iterations) {
+    enum { RB_BUILD, RB_UNION, RB_DIFFERENCE, AVL_BUILD, AVL_UNION, AVL_DIFFERENCE, NR_PARALLEL };
+    static const char* benchmarks[NR_PARALLEL] = {
+        "parallel-build", "parallel-union", "parallel-difference",
+        "parallel-build", "parallel-union", "parallel-difference",
+    };
+    static const char* trees[NR_PARALLEL] = { "RBTree", "RBTree", "RBTree", "AVLTree", "AVLTree", "AVLTree" };
+
+    FILE* file = fopen("parallel_scaling.dat", "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    fprintf(file, "# Threads RBBuild RBUnion RBDifference AVLBuild AVLUnion AVLDifference (ns/key, then speedup over 1 thread)\n");
+
+    int m = n / 4;
+    int* keys = malloc(n * sizeof(int));
+    int* other_keys = malloc(m * sizeof(int));
+    struct my_node* nodes = malloc(n * sizeof(struct my_node));
+    struct my_node* other = malloc(m * sizeof(struct my_node));
+    struct rb_node** links = malloc(n * sizeof(struct rb_node*));
+    double* samples = malloc(iterations * sizeof(double));
+    double base[NR_PARALLEL];
+
+    // Even keys below 2n, and m distinct keys from the same range in ascending order
+    for (int i = 0; i < n; i++)
+        keys[i] = nodes[i].key = 2 * i;
+    for (int k = 0, picked = 0; picked < m; k++)
+        if (rand() % (2 * n - k) < m - picked)
+            other_keys[picked++] = k;
+    for (int i = 0; i < m; i++)
+        other[i].key = other_keys[i];
+
+    set_node_allocator(0);
+    for (int threads = 1; threads <= max_threads; threads = next_thread_count(threads, max_threads)) {
+        struct thread_pool pool;
+        double median[NR_PARALLEL];
+        char workload[32];
+
+        if (thread_pool_init(&pool, threads)) {
+            fprintf(stderr, "cannot start %d threads\n", threads);
+            break;
+        }
+        snprintf(workload, sizeof(workload), "threads=%d", threads);
+
+        for (int b = 0; b < NR_PARALLEL; b++) {
+            for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+                struct rb_root tree = RB_ROOT, other_tree = RB_ROOT;
+                AVLTree avl = NULL, other_avl = NULL;
+                uint64_t start, end;
+                long ops = b == RB_BUILD || b == AVL_BUILD ? n : n + m;
+
+                // Inputs of the set operations are built serially and not timed
+                if (b == RB_UNION || b == RB_DIFFERENCE) {
+                    link_sorted(links, nodes, n);
+                    rb_build_sorted(links, n, &tree);
+                    link_sorted(links, other, m);
+                    rb_build_sorted(links, m, &other_tree);
+                } else if (b == AVL_UNION || b == AVL_DIFFERENCE) {
+                    avl = avltree_build_sorted(keys, n);
+                    other_avl = avltree_build_sorted(other_keys, m);
+                } else if (b == RB_BUILD) {
+                    link_sorted(links, nodes, n);
                 }
-                // Measure Delete
-                for (int i = 0; i < n; i++) {
-                    // RB Tree
-                    struct my_node* node_to_delete = rb_entry(rb_search(&rb_tree, keys[i]), struct my_node, rb);
-                    start = clock();
-                    rb_delete(&rb_tree, node_to_delete);
-                    end = clock();
-                    total_rb_time += get_time_in_seconds(start, end);
-
-                    // AVL Tree
-                    start = clock();
-                    avl_tree = avl_delete(avl_tree, keys[i]);
-                    end = clock();
-                    total_avl_time += get_time_in_seconds(start, end);
+
+                start = bench_now();
+                switch (b) {
+                case RB_BUILD:
+                    rb_build_sorted_parallel(links, n, &tree, &pool);
+                    break;
+                case RB_UNION:
+                    rb_union_parallel(&tree, &other_tree, my_node_cmp, NULL, NULL, &pool);
+                    break;
+                case RB_DIFFERENCE:
+                    rb_difference_parallel(&tree, &other_tree, my_node_cmp, NULL, NULL, &pool);
+                    break;
+                case AVL_BUILD:
+                    avl = avltree_build_sorted_parallel(keys, n, &pool);
+                    break;
+                case AVL_UNION:
+                    avl = avltree_union_parallel(avl, other_avl, &pool);
+                    break;
+                case AVL_DIFFERENCE:
+                    avl = avltree_difference_parallel(avl, other_avl, &pool);
+                    break;
                 }
+                end = bench_now();
+                bench_do_not_optimize(tree.rb_node);
+
+                destroy_avltree(avl);
+                if (iter >= 0)
+                    samples[iter] = bench_ns_per_op(start, end, ops);
             }
 
-            free(keys);
-            // Free AVL tree
-            destroy_avltree(avl_tree);
+            struct bench_stats stats;
+            bench_summarize(samples, iterations, &stats);
+            median[b] = stats.median;
+            if (threads == 1)
+                base[b] = stats.median;
+            results_add(benchmarks[b], trees[b], workload, n, &stats);
         }
+        thread_pool_destroy(&pool);
 
-        fprintf(time_file, "%d %f %f\n", n, total_rb_time / iterations, total_avl_time / iterations);
+        fprintf(file, "%d", threads);
+        for (int b = 0; b < NR_PARALLEL; b++)
+            fprintf(file, " %f", median[b]);
+        for (int b = 0; b < NR_PARALLEL; b++)
+            fprintf(file, " %.2f", base[b] / median[b]);
+        fprintf(file, "\n");
     }
 
-    fclose(time_file);
+    free(samples);
+    free(links);
+    free(other);
+    free(nodes);
+    free(other_keys);
+    free(keys);
+    fclose(file);
 }
 
 int main() {
@@ -260,14 +1488,27 @@ int main() {
     int step_size = 1000; // Increase step size
     int iterations = 50; // Increase iterations for more stable results
 
+    // Every measurement also goes to one CSV record, see bench-compare
+    results_open("avlVSrb_results.csv", "avlVSrb-tst");
+
     measure_performance("insert", max_node_count, step_size, iterations);
     measure_performance("search", max_node_count, step_size, iterations);
     measure_performance("delete", max_node_count, step_size, iterations);
+    measure_node_footprint();
+    measure_workloads(100000, 200000, 5);
+    measure_scaling(1 << 10, 1 << 24, 5);
+    measure_bulk_load(1 << 10, 1 << 22, 5);
+    measure_node_search(1 << 10, 1 << 22, 5);
+    measure_batch_lookup(1 << 16, 1 << 22, 5);
+    measure_rbtree32(1 << 10, 1 << 22, 5);
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    measure_parallel(1 << 22, cpus > 0 ? cpus : 1, 5);
+    results_close();
 
     // Generate gnuplot scripts for each operation
-    generate_gnuplot_script("insert_time.dat", "insert_time.gnuplot", "insert_time.png", "Insertion Performance (Time)", "Time (s)");
-    generate_gnuplot_script("search_time.dat", "search_time.gnuplot", "search_time.png", "Search Performance (Time)", "Time (s)");
-    generate_gnuplot_script("delete_time.dat", "delete_time.gnuplot", "delete_time.png", "Deletion Performance (Time)", "Time (s)");
+    generate_gnuplot_script("insert_time.dat", "insert_time.gnuplot", "insert_time.png", "Insertion Performance (Time)", "Time (ns/op)");
+    generate_gnuplot_script("search_time.dat", "search_time.gnuplot", "search_time.png", "Search Performance (Time)", "Time (ns/op)");
+    generate_gnuplot_script("delete_time.dat", "delete_time.gnuplot", "delete_time.png", "Deletion Performance (Time)", "Time (ns/op)");
 
     // Run gnuplot for each operation
     system("gnuplot insert_time.gnuplot");
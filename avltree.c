@@ -1,10 +1,40 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "avltree.h"
+#include "node_pool.h"
+#include "thread_pool.h"
 
 #define HEIGHT(p)    ( (p==NULL) ? -1 : (((Node *)(p))->height) )
 #define MAX(a, b)    ( (a) > (b) ? (a) : (b) )
 
+/* AVL height is below 1.45*log2(n+2), so this covers any addressable tree */
+#define AVL_MAX_HEIGHT  64
+
+/*
+ * The set operations fork for subtrees at least this high, and the
+ * parallel build for ranges longer than AVL_PARALLEL_CHUNK keys.  Node
+ * pools are not thread-safe, so neither forks while one is set.
+ */
+#define AVL_PARALLEL_HEIGHT  14
+#define AVL_PARALLEL_CHUNK   (1 << 16)
+
+
+static struct node_pool *avltree_pool;
+
+void avltree_set_node_pool(struct node_pool *pool)
+{
+    avltree_pool = pool;
+}
+
+
+static void avltree_free_node(Node *p)
+{
+    if (avltree_pool)
+        node_pool_free(avltree_pool, p);
+    else
+        free(p);
+}
+
 
 int avltree_height(AVLTree tree)
 {
@@ -72,6 +102,62 @@ Node* iterative_avltree_search(AVLTree x, Type key)
 }
 
 
+/*
+ * Search for @n keys at once, found[i] being the node of keys[i] or NULL.
+ * AVL_BATCH descents take turns, each prefetching its next node before
+ * yielding to the others, so that their cache misses overlap instead of
+ * stalling one after the other; a finished descent starts the next key.
+ */
+#define AVL_BATCH 8
+
+void avltree_search_batch(AVLTree tree, const Type keys[], Node* found[], int n)
+{
+    Node* node[AVL_BATCH];
+    int idx[AVL_BATCH];
+    int i, nr, next = 0;
+
+    for (nr = 0; nr < AVL_BATCH && next < n; nr++)
+    {
+        idx[nr] = next++;
+        node[nr] = tree;
+    }
+
+    while (nr)
+    {
+        for (i = 0; i < nr; i++)
+        {
+            Node* x = node[i];
+            Type key = keys[idx[i]];
+
+            if (x != NULL && x->key != key)
+            {
+                x = key < x->key ? x->left : x->right;
+                if (x != NULL)
+                {
+                    __builtin_prefetch(x);
+                    node[i] = x;
+                    continue;
+                }
+            }
+
+            found[idx[i]] = x;
+            if (next < n)
+            {
+                idx[i] = next++;
+                node[i] = tree;
+            }
+            else
+            {
+                nr--;
+                idx[i] = idx[nr];
+                node[i] = node[nr];
+                i--;
+            }
+        }
+    }
+}
+
+
 Node* avltree_minimum(AVLTree tree)
 {
     if (tree == NULL)
@@ -140,11 +226,62 @@ static Node* right_left_rotation(AVLTree k1)
 }
 
 
+/*
+ * Restore the balance of @tree, whose subtrees are AVL trees differing in
+ * height by at most 2, and refresh its height.  Returns the new subtree root.
+ */
+static Node* avltree_rebalance(AVLTree tree)
+{
+    int balance = HEIGHT(tree->left) - HEIGHT(tree->right);
+
+    if (balance == 2)
+    {
+        if (HEIGHT(tree->left->left) >= HEIGHT(tree->left->right))
+            return left_left_rotation(tree);
+        else
+            return left_right_rotation(tree);
+    }
+    if (balance == -2)
+    {
+        if (HEIGHT(tree->right->right) >= HEIGHT(tree->right->left))
+            return right_right_rotation(tree);
+        else
+            return right_left_rotation(tree);
+    }
+
+    tree->height = MAX( HEIGHT(tree->left), HEIGHT(tree->right)) + 1;
+    return tree;
+}
+
+
+/*
+ * Retrace the recorded descent bottom-up.  Each entry is the link that
+ * points at a node on the path, so a rotation just rewrites that link.
+ * Once a subtree's height comes out unchanged nothing above it can change.
+ */
+static void avltree_retrace(Node **path[], int depth)
+{
+    while (depth > 0)
+    {
+        Node **link = path[--depth];
+        int height = (*link)->height;
+
+        *link = avltree_rebalance(*link);
+        if ((*link)->height == height)
+            break;
+    }
+}
+
+
 static Node* avltree_create_node(Type key, Node *left, Node* right)
 {
     Node* p;
 
-    if ((p = (Node *)malloc(sizeof(Node))) == NULL)
+    if (avltree_pool)
+        p = (Node *)node_pool_alloc(avltree_pool);
+    else
+        p = (Node *)malloc(sizeof(Node));
+    if (p == NULL)
         return NULL;
     p->key = key;
     p->height = 0;
@@ -200,6 +337,58 @@ Node* avltree_insert(AVLTree tree, Type key)
 }
 
 
+Node* iterative_avltree_insert(AVLTree tree, Type key)
+{
+    Node **path[AVL_MAX_HEIGHT];
+    Node **link = &tree;
+    int depth = 0;
+
+    while (*link != NULL)
+    {
+        if (key == (*link)->key)
+        {
+            printf("Adding the same node is not allowed！\n");
+            return tree;
+        }
+        path[depth++] = link;
+        link = (key < (*link)->key) ? &(*link)->left : &(*link)->right;
+    }
+
+    if ((*link = avltree_create_node(key, NULL, NULL)) == NULL)
+    {
+        printf("ERROR: create avltree node failed!\n");
+        return tree;
+    }
+
+    avltree_retrace(path, depth);
+    return tree;
+}
+
+
+Node* avltree_build_sorted(const Type keys[], int n)
+{
+    Node *left, *right, *node;
+    int mid = n / 2;
+
+    if (n <= 0)
+        return NULL;
+
+    /* The middle key is the root; halves differ in size by at most one */
+    left = avltree_build_sorted(keys, mid);
+    right = avltree_build_sorted(keys + mid + 1, n - mid - 1);
+    if ((mid > 0 && left == NULL) || (n - mid - 1 > 0 && right == NULL) ||
+        (node = avltree_create_node(keys[mid], left, right)) == NULL)
+    {
+        destroy_avltree(left);
+        destroy_avltree(right);
+        return NULL;
+    }
+    node->height = MAX(HEIGHT(left), HEIGHT(right)) + 1;
+
+    return node;
+}
+
+
 static Node* delete_node(AVLTree tree, Node *z)
 {
 
@@ -244,7 +433,7 @@ static Node* delete_node(AVLTree tree, Node *z)
             }
             else
             {
-                Node *min = avltree_maximum(tree->right);
+                Node *min = avltree_minimum(tree->right);
                 tree->key = min->key;
                 tree->right = delete_node(tree->right, min);
             }
@@ -253,10 +442,13 @@ static Node* delete_node(AVLTree tree, Node *z)
         {
             Node *tmp = tree;
             tree = tree->left ? tree->left : tree->right;
-            free(tmp);
+            avltree_free_node(tmp);
         }
     }
 
+    if (tree != NULL)
+        tree->height = MAX( HEIGHT(tree->left), HEIGHT(tree->right)) + 1;
+
     return tree;
 }
 
@@ -269,6 +461,46 @@ Node* avltree_delete(AVLTree tree, Type key)
     return tree;
 }
 
+Node* iterative_avltree_delete(AVLTree tree, Type key)
+{
+    Node **path[AVL_MAX_HEIGHT];
+    Node **link = &tree, *z;
+    int depth = 0;
+
+    while (*link != NULL && (*link)->key != key)
+    {
+        path[depth++] = link;
+        link = (key < (*link)->key) ? &(*link)->left : &(*link)->right;
+    }
+    if ((z = *link) == NULL)
+        return tree;
+
+    if ((z->left) && (z->right))
+    {
+        /* Take over the successor's key and unlink the successor instead */
+        Node **succ = &z->right, *s;
+
+        path[depth++] = link;
+        while ((*succ)->left != NULL)
+        {
+            path[depth++] = succ;
+            succ = &(*succ)->left;
+        }
+        s = *succ;
+        z->key = s->key;
+        *succ = s->right;
+        avltree_free_node(s);
+    }
+    else
+    {
+        *link = z->left ? z->left : z->right;
+        avltree_free_node(z);
+    }
+
+    avltree_retrace(path, depth);
+    return tree;
+}
+
 void destroy_avltree(AVLTree tree)
 {
     if (tree==NULL)
@@ -279,7 +511,269 @@ void destroy_avltree(AVLTree tree)
     if (tree->right != NULL)
         destroy_avltree(tree->right);
 
-    free(tree);
+    avltree_free_node(tree);
+}
+
+/*
+ * Join and split (Blelloch et al., "Just Join for Parallel Ordered Sets").
+ * avltree_join() links @left, @mid and @right, which sort in that order:
+ * it walks down the spine of the taller tree to a subtree at most one
+ * higher than the other tree and hangs both below @mid there, and a single
+ * rebalance per level on the way back restores the AVL property.
+ */
+static Node* avltree_join_right(AVLTree left, Node *mid, AVLTree right)
+{
+    if (HEIGHT(left->right) <= HEIGHT(right) + 1)
+    {
+        mid->left = left->right;
+        mid->right = right;
+        mid->height = MAX( HEIGHT(mid->left), HEIGHT(right)) + 1;
+        left->right = mid;
+    }
+    else
+        left->right = avltree_join_right(left->right, mid, right);
+
+    return avltree_rebalance(left);
+}
+
+static Node* avltree_join_left(AVLTree left, Node *mid, AVLTree right)
+{
+    if (HEIGHT(right->left) <= HEIGHT(left) + 1)
+    {
+        mid->left = left;
+        mid->right = right->left;
+        mid->height = MAX( HEIGHT(left), HEIGHT(mid->right)) + 1;
+        right->left = mid;
+    }
+    else
+        right->left = avltree_join_left(left, mid, right->left);
+
+    return avltree_rebalance(right);
+}
+
+static Node* avltree_join(AVLTree left, Node *mid, AVLTree right)
+{
+    if (HEIGHT(left) > HEIGHT(right) + 1)
+        return avltree_join_right(left, mid, right);
+    if (HEIGHT(right) > HEIGHT(left) + 1)
+        return avltree_join_left(left, mid, right);
+
+    mid->left = left;
+    mid->right = right;
+    mid->height = MAX( HEIGHT(left), HEIGHT(right)) + 1;
+    return mid;
+}
+
+/* Split @tree into the keys below and above @key; returns the node holding @key, if any */
+static Node* avltree_split(AVLTree tree, Type key, AVLTree *left, AVLTree *right)
+{
+    Node *found, *tmp;
+
+    if (tree == NULL)
+    {
+        *left = *right = NULL;
+        return NULL;
+    }
+
+    if (key < tree->key)
+    {
+        found = avltree_split(tree->left, key, left, &tmp);
+        *right = avltree_join(tmp, tree, tree->right);
+    }
+    else if (key > tree->key)
+    {
+        found = avltree_split(tree->right, key, &tmp, right);
+        *left = avltree_join(tree->left, tree, tmp);
+    }
+    else
+    {
+        *left = tree->left;
+        *right = tree->right;
+        found = tree;
+    }
+    return found;
+}
+
+/* Take the maximum out of the non-empty @tree, leaving the other nodes in @rest */
+static Node* avltree_split_last(AVLTree tree, AVLTree *rest)
+{
+    Node *last, *tmp;
+
+    if (tree->right == NULL)
+    {
+        *rest = tree->left;
+        return tree;
+    }
+
+    last = avltree_split_last(tree->right, &tmp);
+    *rest = avltree_join(tree->left, tree, tmp);
+    return last;
+}
+
+static Node* avltree_join2(AVLTree left, AVLTree right)
+{
+    Node *last;
+
+    if (left == NULL)
+        return right;
+    last = avltree_split_last(left, &left);
+    return avltree_join(left, last, right);
+}
+
+struct avltree_setop_task
+{
+    struct thread_pool_task task;
+    Node* (*fn)(AVLTree a, AVLTree b);
+    AVLTree a, b, result;
+};
+
+static void avltree_setop_run(void *data)
+{
+    struct avltree_setop_task *t = data;
+
+    t->result = t->fn(t->a, t->b);
+}
+
+/*
+ * Split @b around the root of @a and apply @fn to both pairs of halves,
+ * the left pair as a pool task when it is large.  Returns the node of @b
+ * holding the key of @a's root, if any.
+ */
+static Node* avltree_setop_recurse(Node* (*fn)(AVLTree a, AVLTree b), AVLTree a, AVLTree b,
+                                   AVLTree *left, AVLTree *right)
+{
+    struct avltree_setop_task t = { .fn = fn, .a = a->left };
+    Node *dup = avltree_split(b, a->key, &t.b, &b);
+
+    if (HEIGHT(a->left) >= AVL_PARALLEL_HEIGHT && avltree_pool == NULL)
+    {
+        thread_pool_fork(&t.task, avltree_setop_run, &t);
+        *right = fn(a->right, b);
+        thread_pool_join(&t.task);
+        *left = t.result;
+    }
+    else
+    {
+        *left = fn(t.a, t.b);
+        *right = fn(a->right, b);
+    }
+    return dup;
+}
+
+static Node* avltree_union_recurse(AVLTree a, AVLTree b)
+{
+    Node *left, *right, *dup;
+
+    if (a == NULL)
+        return b;
+    if (b == NULL)
+        return a;
+
+    dup = avltree_setop_recurse(avltree_union_recurse, a, b, &left, &right);
+    if (dup != NULL)
+        avltree_free_node(dup);
+    return avltree_join(left, a, right);
+}
+
+static Node* avltree_difference_recurse(AVLTree a, AVLTree b)
+{
+    Node *left, *right, *dup;
+
+    if (a == NULL)
+    {
+        destroy_avltree(b);
+        return NULL;
+    }
+    if (b == NULL)
+        return a;
+
+    dup = avltree_setop_recurse(avltree_difference_recurse, a, b, &left, &right);
+    if (dup == NULL)
+        return avltree_join(left, a, right);
+
+    avltree_free_node(dup);
+    avltree_free_node(a);
+    return avltree_join2(left, right);
+}
+
+static Node* avltree_setop(Node* (*fn)(AVLTree a, AVLTree b), AVLTree a, AVLTree b,
+                           struct thread_pool *pool)
+{
+    struct avltree_setop_task t = { .fn = fn, .a = a, .b = b };
+
+    if (pool != NULL && avltree_pool == NULL)
+        thread_pool_run(pool, avltree_setop_run, &t);
+    else
+        avltree_setop_run(&t);
+    return t.result;
+}
+
+Node* avltree_union(AVLTree a, AVLTree b)
+{
+    return avltree_setop(avltree_union_recurse, a, b, NULL);
+}
+
+Node* avltree_difference(AVLTree a, AVLTree b)
+{
+    return avltree_setop(avltree_difference_recurse, a, b, NULL);
+}
+
+Node* avltree_union_parallel(AVLTree a, AVLTree b, struct thread_pool *pool)
+{
+    return avltree_setop(avltree_union_recurse, a, b, pool);
+}
+
+Node* avltree_difference_parallel(AVLTree a, AVLTree b, struct thread_pool *pool)
+{
+    return avltree_setop(avltree_difference_recurse, a, b, pool);
+}
+
+struct avltree_build_task
+{
+    struct thread_pool_task task;
+    const Type *keys;
+    int n;
+    Node *tree;
+};
+
+/* avltree_build_sorted(), with the left half of long ranges as a pool task */
+static void avltree_build_run(void *data)
+{
+    struct avltree_build_task *t = data;
+    int mid = t->n / 2;
+    struct avltree_build_task left = { .keys = t->keys, .n = mid };
+    struct avltree_build_task right = { .keys = t->keys + mid + 1, .n = t->n - mid - 1 };
+
+    if (t->n <= AVL_PARALLEL_CHUNK || avltree_pool != NULL)
+    {
+        t->tree = avltree_build_sorted(t->keys, t->n);
+        return;
+    }
+
+    thread_pool_fork(&left.task, avltree_build_run, &left);
+    avltree_build_run(&right);
+    thread_pool_join(&left.task);
+
+    if (left.tree == NULL || right.tree == NULL ||
+        (t->tree = avltree_create_node(t->keys[mid], left.tree, right.tree)) == NULL)
+    {
+        destroy_avltree(left.tree);
+        destroy_avltree(right.tree);
+        t->tree = NULL;
+        return;
+    }
+    t->tree->height = MAX(HEIGHT(left.tree), HEIGHT(right.tree)) + 1;
+}
+
+Node* avltree_build_sorted_parallel(const Type keys[], int n, struct thread_pool *pool)
+{
+    struct avltree_build_task t = { .keys = keys, .n = n };
+
+    if (pool != NULL && avltree_pool == NULL)
+        thread_pool_run(pool, avltree_build_run, &t);
+    else
+        avltree_build_run(&t);
+    return t.tree;
 }
 
 void print_avltree(AVLTree tree, Type key, int direction) {
@@ -11,6 +11,13 @@ typedef struct AVLTreeNode{
 }Node, *AVLTree;
 
 
+struct node_pool;
+struct thread_pool;
+
+/* Allocate nodes from @pool (sized for a Node) instead of malloc; NULL restores malloc */
+void avltree_set_node_pool(struct node_pool *pool);
+
+
 int avltree_height(AVLTree tree);
 
 
@@ -27,6 +34,9 @@ Node* avltree_search(AVLTree x, Type key);
 
 Node* iterative_avltree_search(AVLTree x, Type key);
 
+/* found[i] = the node of keys[i] or NULL, with the descents interleaved to overlap cache misses */
+void avltree_search_batch(AVLTree tree, const Type keys[], Node* found[], int n);
+
 
 Node* avltree_minimum(AVLTree tree);
 
@@ -35,9 +45,30 @@ Node* avltree_maximum(AVLTree tree);
 
 Node* avltree_insert(AVLTree tree, Type key);
 
+Node* iterative_avltree_insert(AVLTree tree, Type key);
+
+
+/* Build a balanced tree from @n strictly increasing keys in O(n); NULL if allocation fails */
+Node* avltree_build_sorted(const Type keys[], int n);
+
+
+/* a | b and a - b by join and split, O(m log(n/m + 1)); both trees are consumed */
+Node* avltree_union(AVLTree a, AVLTree b);
+
+Node* avltree_difference(AVLTree a, AVLTree b);
+
+/* The same, and the bulk build, with the work spread over @pool unless a node pool is set */
+Node* avltree_union_parallel(AVLTree a, AVLTree b, struct thread_pool *pool);
+
+Node* avltree_difference_parallel(AVLTree a, AVLTree b, struct thread_pool *pool);
+
+Node* avltree_build_sorted_parallel(const Type keys[], int n, struct thread_pool *pool);
+
 
 Node* avltree_delete(AVLTree tree, Type key);
 
+Node* iterative_avltree_delete(AVLTree tree, Type key);
+
 
 void destroy_avltree(AVLTree tree);
 
@@ -0,0 +1,156 @@
+// Compare two benchmark result files written through results.h (see
+// RESULTS_HEADER for the columns):
+//
+//   ./bench-compare [-t percent] <baseline.csv> <candidate.csv>
+//
+// Rows are matched on driver, benchmark, tree, workload and N.  A row
+// regresses when its mean ns/op got slower by more than the threshold
+// (default 5%) and Welch's t-test says the difference is significant at
+// the 95% level.  Rows with a single sample cannot be tested and are only
+// reported.  The exit status is 1 if anything regressed, so the tool can
+// gate changes to the trees.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bench.h"
+
+enum { F_DRIVER = 6, F_BENCHMARK, F_TREE, F_WORKLOAD, F_N, F_UNIT, F_SAMPLES, F_MEAN, F_STDDEV, NR_FIELDS = 21 };
+
+struct result {
+    char key[512];
+    int samples;
+    double mean, stddev;
+};
+
+static int parse_line(char* line, struct result* r) {
+    char* fields[NR_FIELDS];
+    int nr = 0;
+
+    line[strcspn(line, "\n")] = '\0';
+    for (char* p = line; nr < NR_FIELDS; ) {
+        fields[nr++] = p;
+        if (!(p = strchr(p, ',')))
+            break;
+        *p++ = '\0';
+    }
+    if (nr != NR_FIELDS || strcmp(fields[0], "timestamp") == 0)
+        return -1;
+
+    snprintf(r->key, sizeof(r->key), "%s %s %s %s %s", fields[F_DRIVER], fields[F_BENCHMARK],
+             fields[F_TREE], fields[F_WORKLOAD], fields[F_N]);
+    r->samples = atoi(fields[F_SAMPLES]);
+    r->mean = atof(fields[F_MEAN]);
+    r->stddev = atof(fields[F_STDDEV]);
+    return 0;
+}
+
+static struct result* load_results(const char* path, int* count) {
+    struct result* results = NULL;
+    int capacity = 0;
+    char line[2048];
+    FILE* file = fopen(path, "r");
+
+    *count = 0;
+    if (!file) {
+        perror(path);
+        return NULL;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        if (*count == capacity) {
+            struct result* grown;
+
+            capacity = capacity ? capacity * 2 : 256;
+            if (!(grown = realloc(results, capacity * sizeof(struct result)))) {
+                fprintf(stderr, "%s: out of memory\n", path);
+                free(results);
+                fclose(file);
+                return NULL;
+            }
+            results = grown;
+        }
+        if (parse_line(line, &results[*count]) == 0)
+            (*count)++;
+    }
+    fclose(file);
+
+    if (*count == 0) {
+        fprintf(stderr, "no records in %s\n", path);
+        free(results);
+        return NULL;
+    }
+    return results;
+}
+
+// Welch's t statistic and whether it is significant at 95%
+static int welch_significant(const struct result* a, const struct result* b, double* t) {
+    double va = a->stddev * a->stddev / a->samples, vb = b->stddev * b->stddev / b->samples;
+    double se = sqrt(va + vb);
+
+    if (a->samples < 2 || b->samples < 2)
+        return -1;
+    if (se == 0.0) {
+        *t = 0.0;
+        return a->mean != b->mean;
+    }
+    *t = (b->mean - a->mean) / se;
+
+    // Welch-Satterthwaite degrees of freedom
+    double df = (va + vb) * (va + vb) /
+                (va * va / (a->samples - 1) + vb * vb / (b->samples - 1));
+    return fabs(*t) > bench_t975(df < 1.0 ? 1 : (int)df);
+}
+
+int main(int argc, char* argv[]) {
+    double threshold = 5.0;
+    int argi = 1, n_old, n_new, regressions = 0, improvements = 0;
+
+    if (argc == 5 && strcmp(argv[1], "-t") == 0) {
+        threshold = atof(argv[2]);
+        argi = 3;
+    }
+    if (argc - argi != 2) {
+        fprintf(stderr, "Usage: %s [-t percent] <baseline.csv> <candidate.csv>\n", argv[0]);
+        return 2;
+    }
+
+    struct result* old = load_results(argv[argi], &n_old);
+    struct result* new = load_results(argv[argi + 1], &n_new);
+    if (!old || !new) {
+        free(old);
+        free(new);
+        return 2;
+    }
+
+    printf("%-60s %12s %12s %8s %8s  %s\n", "benchmark", "baseline", "candidate", "change", "t", "verdict");
+    for (int i = 0; i < n_new; i++) {
+        struct result* a = NULL;
+        for (int j = 0; j < n_old && !a; j++)
+            if (strcmp(old[j].key, new[i].key) == 0)
+                a = &old[j];
+        if (!a || a->mean <= 0.0)
+            continue;
+
+        double t = 0.0, change = (new[i].mean - a->mean) / a->mean * 100.0;
+        int significant = welch_significant(a, &new[i], &t);
+        const char* verdict = "";
+
+        if (fabs(change) > threshold) {
+            if (significant < 0) {
+                verdict = "untested (single sample)";
+            } else if (significant && change > 0) {
+                verdict = "REGRESSION";
+                regressions++;
+            } else if (significant) {
+                verdict = "improvement";
+                improvements++;
+            }
+        }
+        printf("%-60s %12.2f %12.2f %7.1f%% %8.2f  %s\n", new[i].key, a->mean, new[i].mean, change, t, verdict);
+    }
+    printf("%d regressions, %d improvements beyond %.1f%%\n", regressions, improvements, threshold);
+
+    free(old);
+    free(new);
+    return regressions ? 1 : 0;
+}
@@ -0,0 +1,70 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Two-sided 97.5% quantiles of Student's t for 1..30 degrees of freedom */
+static const double t975[30] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+double bench_t975(int df)
+{
+	if (df <= 0)
+		return 0.0;
+	return df <= 30 ? t975[df - 1] : 1.96;
+}
+
+/* Linear interpolation between the closest ranks, @p in [0, 1] */
+double bench_percentile(const double *sorted, int n, double p)
+{
+	double pos;
+	int i;
+
+	if (n <= 0)
+		return 0.0;
+	pos = p * (n - 1);
+	i = (int)pos;
+	if (i >= n - 1)
+		return sorted[n - 1];
+	return sorted[i] + (pos - i) * (sorted[i + 1] - sorted[i]);
+}
+
+void bench_summarize(double *samples, int n, struct bench_stats *stats)
+{
+	double sum = 0.0, sq = 0.0;
+	int i;
+
+	memset(stats, 0, sizeof(*stats));
+	stats->samples = n;
+	if (n <= 0)
+		return;
+
+	qsort(samples, n, sizeof(*samples), cmp_double);
+
+	for (i = 0; i < n; i++)
+		sum += samples[i];
+	stats->mean = sum / n;
+	for (i = 0; i < n; i++)
+		sq += (samples[i] - stats->mean) * (samples[i] - stats->mean);
+	if (n > 1) {
+		stats->stddev = sqrt(sq / (n - 1));
+		stats->ci95 = bench_t975(n - 1) * stats->stddev / sqrt(n);
+	}
+
+	stats->min = samples[0];
+	stats->max = samples[n - 1];
+	stats->median = bench_percentile(samples, n, 0.5);
+	stats->p90 = bench_percentile(samples, n, 0.9);
+	stats->p99 = bench_percentile(samples, n, 0.99);
+}
@@ -0,0 +1,65 @@
+/*
+ * Batch timing harness
+ *
+ * clock() has microsecond-or-worse resolution and costs more than a tree
+ * lookup, so timing single operations with it measures mostly the timer.
+ * Instead a benchmark times a whole batch of operations with the
+ * monotonic clock, repeats the batch after some unrecorded warm-up runs,
+ * and reports the distribution of the per-operation times:
+ *
+ *	double samples[REPS];
+ *	struct bench_stats st;
+ *
+ *	for (r = -WARMUP; r < REPS; r++) {
+ *		uint64_t t0 = bench_now();
+ *		for (i = 0; i < n; i++)
+ *			bench_do_not_optimize(lookup(tree, keys[i]));
+ *		uint64_t t1 = bench_now();
+ *		if (r >= 0)
+ *			samples[r] = bench_ns_per_op(t0, t1, n);
+ *	}
+ *	bench_summarize(samples, REPS, &st);
+ */
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+#include <stdint.h>
+#include <time.h>
+
+struct bench_stats
+{
+	int samples;
+	double mean, stddev;
+	double ci95;			/* half-width of the 95% interval of the mean */
+	double min, median, p90, p99, max;
+};
+
+/* Nanoseconds on the monotonic clock */
+static inline uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline double bench_ns_per_op(uint64_t start, uint64_t end, long ops)
+{
+	return ops > 0 ? (double)(end - start) / ops : 0.0;
+}
+
+/*
+ * Make @val look used, so the computation producing it is not dropped,
+ * and stop the compiler from moving memory accesses across this point.
+ */
+#define bench_do_not_optimize(val)	__asm__ __volatile__("" : : "g"(val) : "memory")
+#define bench_clobber()			__asm__ __volatile__("" : : : "memory")
+
+/* Sorts @samples in place */
+extern void bench_summarize(double *samples, int n, struct bench_stats *stats);
+extern double bench_percentile(const double *sorted, int n, double p);
+/* Two-sided 95% critical value of Student's t with @df degrees of freedom */
+extern double bench_t975(int df);
+
+#endif	/* _BENCH_H */
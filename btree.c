@@ -0,0 +1,432 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "btree.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BTREE_X86
+#endif
+
+#define BTREE_NEXT_LEAF		BTREE_KEYS	/* slot of a leaf's successor */
+
+static struct btree_node *btree_alloc_node(void)
+{
+	struct btree_node *node;
+
+	if (posix_memalign((void **)&node, BTREE_CACHELINE, sizeof(*node)))
+		return NULL;
+	node->nr = 0;
+	node->slots[BTREE_NEXT_LEAF] = NULL;
+	return node;
+}
+
+/* Slot of @key in a leaf: the number of keys below it */
+static inline int btree_leaf_slot(const struct btree_node *node, int key)
+{
+	int i, pos = 0;
+
+	for (i = 0; i < node->nr; i++)
+		pos += node->keys[i] < key;
+	return pos;
+}
+
+/* Child of an inner node covering @key: the number of separators not above it */
+static inline int btree_child_slot(const struct btree_node *node, int key)
+{
+	int i, pos = 0;
+
+	for (i = 0; i < node->nr; i++)
+		pos += node->keys[i] <= key;
+	return pos;
+}
+
+/*
+ * The SIMD kernels compare whole vectors of keys, so they read up to 7 ints
+ * past keys[BTREE_KEYS - 1]; those are still inside the node (nr and the
+ * slots).  Nothing masks the lanes from nr up: they compare stale keys or
+ * those bytes and are ORed in with the rest.  That is harmless only because
+ * bit nr is set beforehand and ctz stops at the lowest set bit.  Keys are
+ * sorted, so the lanes below nr that are above @key form a suffix, and its
+ * first one, or nr if there is none, is the child slot.
+ */
+#ifdef BTREE_X86
+static inline __attribute__((target("sse2")))
+int btree_child_slot_sse2(const struct btree_node *node, int key)
+{
+	__m128i k = _mm_set1_epi32(key);
+	unsigned long long above = 1ULL << node->nr;
+	int i;
+
+	for (i = 0; i < BTREE_KEYS; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(node->keys + i));
+
+		above |= (unsigned long long)_mm_movemask_ps(
+			_mm_castsi128_ps(_mm_cmpgt_epi32(v, k))) << i;
+	}
+	return __builtin_ctzll(above);
+}
+
+static inline __attribute__((target("avx2")))
+int btree_child_slot_avx2(const struct btree_node *node, int key)
+{
+	__m256i k = _mm256_set1_epi32(key);
+	unsigned long long above = 1ULL << node->nr;
+	int i;
+
+	for (i = 0; i < BTREE_KEYS; i += 8) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(node->keys + i));
+
+		above |= (unsigned long long)_mm256_movemask_ps(
+			_mm256_castsi256_ps(_mm256_cmpgt_epi32(v, k))) << i;
+	}
+	return __builtin_ctzll(above);
+}
+#endif
+
+/*
+ * One lookup per kernel, so that the kernel is inlined into the descent
+ * and compiled for its instruction set.  The leaf is searched the same
+ * way: @key, if present, is the last key not above it.
+ */
+#define BTREE_DEFINE_LOOKUP(name, child_slot, attr)				\
+static attr void *name(const struct btree *tree, int key)			\
+{										\
+	const struct btree_node *node = tree->root;				\
+	int level, pos;								\
+										\
+	if (!node)								\
+		return NULL;							\
+										\
+	for (level = tree->height; level > 0; level--)				\
+		node = node->slots[child_slot(node, key)];			\
+										\
+	pos = child_slot(node, key);						\
+	if (pos > 0 && node->keys[pos - 1] == key)				\
+		return node->slots[pos - 1];					\
+	return NULL;								\
+}
+
+BTREE_DEFINE_LOOKUP(btree_lookup_scalar, btree_child_slot, )
+#ifdef BTREE_X86
+BTREE_DEFINE_LOOKUP(btree_lookup_sse2, btree_child_slot_sse2, __attribute__((target("sse2"))))
+BTREE_DEFINE_LOOKUP(btree_lookup_avx2, btree_child_slot_avx2, __attribute__((target("avx2"))))
+#endif
+
+static void *(*btree_lookup_fn)(const struct btree *tree, int key) = btree_lookup_scalar;
+
+int btree_set_search(enum btree_search search)
+{
+#ifdef BTREE_X86
+	__builtin_cpu_init();
+	if (search == BTREE_SEARCH_AUTO)
+		search = __builtin_cpu_supports("avx2") ? BTREE_SEARCH_AVX2 :
+			 __builtin_cpu_supports("sse2") ? BTREE_SEARCH_SSE2 :
+			 BTREE_SEARCH_SCALAR;
+
+	if (search == BTREE_SEARCH_AVX2 && __builtin_cpu_supports("avx2")) {
+		btree_lookup_fn = btree_lookup_avx2;
+		return 0;
+	}
+	if (search == BTREE_SEARCH_SSE2 && __builtin_cpu_supports("sse2")) {
+		btree_lookup_fn = btree_lookup_sse2;
+		return 0;
+	}
+#else
+	if (search == BTREE_SEARCH_AUTO)
+		search = BTREE_SEARCH_SCALAR;
+#endif
+	if (search == BTREE_SEARCH_SCALAR) {
+		btree_lookup_fn = btree_lookup_scalar;
+		return 0;
+	}
+	return -EOPNOTSUPP;
+}
+
+static void __attribute__((constructor)) btree_init_search(void)
+{
+	btree_set_search(BTREE_SEARCH_AUTO);
+}
+
+void *btree_lookup(const struct btree *tree, int key)
+{
+	return btree_lookup_fn(tree, key);
+}
+
+/*
+ * Split the full child @pos of @parent, which sits on @level (0 for the
+ * leaves), in two and add the new right half and its separator to
+ * @parent, which must have room for them.
+ */
+static int btree_split_child(struct btree_node *parent, int pos, int level)
+{
+	struct btree_node *child = parent->slots[pos], *right;
+	int half = BTREE_KEYS / 2, sep;
+
+	if (!(right = btree_alloc_node()))
+		return -ENOMEM;
+
+	if (level == 0) {
+		/* Leaves keep every key; the right one's first is copied up */
+		right->nr = BTREE_KEYS - half;
+		memcpy(right->keys, child->keys + half, right->nr * sizeof(int));
+		memcpy(right->slots, child->slots + half, right->nr * sizeof(void *));
+		right->slots[BTREE_NEXT_LEAF] = child->slots[BTREE_NEXT_LEAF];
+		child->slots[BTREE_NEXT_LEAF] = right;
+		sep = right->keys[0];
+	} else {
+		/* The middle separator moves up */
+		right->nr = BTREE_KEYS - half - 1;
+		memcpy(right->keys, child->keys + half + 1, right->nr * sizeof(int));
+		memcpy(right->slots, child->slots + half + 1, (right->nr + 1) * sizeof(void *));
+		sep = child->keys[half];
+	}
+	child->nr = half;
+
+	memmove(parent->keys + pos + 1, parent->keys + pos,
+		(parent->nr - pos) * sizeof(int));
+	memmove(parent->slots + pos + 2, parent->slots + pos + 1,
+		(parent->nr - pos) * sizeof(void *));
+	parent->keys[pos] = sep;
+	parent->slots[pos + 1] = right;
+	parent->nr++;
+	return 0;
+}
+
+/* Returns 0, -EEXIST if @key is already present, or -ENOMEM */
+int btree_insert(struct btree *tree, int key, void *value)
+{
+	struct btree_node *node, *child;
+	int level, pos;
+
+	if (!tree->root && !(tree->root = btree_alloc_node()))
+		return -ENOMEM;
+
+	/* A full root is split under a new root, the only way the tree grows */
+	if (tree->root->nr == BTREE_KEYS) {
+		if (!(node = btree_alloc_node()))
+			return -ENOMEM;
+		node->slots[0] = tree->root;
+		if (btree_split_child(node, 0, tree->height)) {
+			free(node);
+			return -ENOMEM;
+		}
+		tree->root = node;
+		tree->height++;
+	}
+
+	node = tree->root;
+	for (level = tree->height; level > 0; level--) {
+		pos = btree_child_slot(node, key);
+		child = node->slots[pos];
+		if (child->nr == BTREE_KEYS) {
+			if (btree_split_child(node, pos, level - 1))
+				return -ENOMEM;
+			if (key >= node->keys[pos])
+				pos++;
+			child = node->slots[pos];
+		}
+		node = child;
+	}
+
+	pos = btree_leaf_slot(node, key);
+	if (pos < node->nr && node->keys[pos] == key)
+		return -EEXIST;
+
+	memmove(node->keys + pos + 1, node->keys + pos, (node->nr - pos) * sizeof(int));
+	memmove(node->slots + pos + 1, node->slots + pos, (node->nr - pos) * sizeof(void *));
+	node->keys[pos] = key;
+	node->slots[pos] = value;
+	node->nr++;
+	tree->count++;
+	return 0;
+}
+
+/* Move the last key of child @pos - 1 of @parent over to child @pos */
+static void btree_borrow_left(struct btree_node *parent, int pos, int level)
+{
+	struct btree_node *left = parent->slots[pos - 1], *child = parent->slots[pos];
+
+	memmove(child->keys + 1, child->keys, child->nr * sizeof(int));
+	if (level == 0) {
+		memmove(child->slots + 1, child->slots, child->nr * sizeof(void *));
+		child->keys[0] = left->keys[left->nr - 1];
+		child->slots[0] = left->slots[left->nr - 1];
+		parent->keys[pos - 1] = child->keys[0];
+	} else {
+		memmove(child->slots + 1, child->slots, (child->nr + 1) * sizeof(void *));
+		child->keys[0] = parent->keys[pos - 1];
+		child->slots[0] = left->slots[left->nr];
+		parent->keys[pos - 1] = left->keys[left->nr - 1];
+	}
+	left->nr--;
+	child->nr++;
+}
+
+/* Move the first key of child @pos + 1 of @parent over to child @pos */
+static void btree_borrow_right(struct btree_node *parent, int pos, int level)
+{
+	struct btree_node *child = parent->slots[pos], *right = parent->slots[pos + 1];
+
+	if (level == 0) {
+		child->keys[child->nr] = right->keys[0];
+		child->slots[child->nr] = right->slots[0];
+		memmove(right->slots, right->slots + 1, (right->nr - 1) * sizeof(void *));
+		parent->keys[pos] = right->keys[1];
+	} else {
+		child->keys[child->nr] = parent->keys[pos];
+		child->slots[child->nr + 1] = right->slots[0];
+		memmove(right->slots, right->slots + 1, right->nr * sizeof(void *));
+		parent->keys[pos] = right->keys[0];
+	}
+	memmove(right->keys, right->keys + 1, (right->nr - 1) * sizeof(int));
+	child->nr++;
+	right->nr--;
+}
+
+/* Append child @pos + 1 of @parent, and the separator between them, to child @pos */
+static void btree_merge(struct btree_node *parent, int pos, int level)
+{
+	struct btree_node *child = parent->slots[pos], *right = parent->slots[pos + 1];
+
+	if (level == 0) {
+		memcpy(child->keys + child->nr, right->keys, right->nr * sizeof(int));
+		memcpy(child->slots + child->nr, right->slots, right->nr * sizeof(void *));
+		child->slots[BTREE_NEXT_LEAF] = right->slots[BTREE_NEXT_LEAF];
+		child->nr += right->nr;
+	} else {
+		child->keys[child->nr] = parent->keys[pos];
+		memcpy(child->keys + child->nr + 1, right->keys, right->nr * sizeof(int));
+		memcpy(child->slots + child->nr + 1, right->slots, (right->nr + 1) * sizeof(void *));
+		child->nr += right->nr + 1;
+	}
+	free(right);
+
+	memmove(parent->keys + pos, parent->keys + pos + 1,
+		(parent->nr - pos - 1) * sizeof(int));
+	memmove(parent->slots + pos + 1, parent->slots + pos + 2,
+		(parent->nr - pos - 1) * sizeof(void *));
+	parent->nr--;
+}
+
+/*
+ * Give child @pos of @parent more than BTREE_MIN_KEYS keys, so that a
+ * removal below it cannot leave it short, and return the child that now
+ * covers its keys.
+ */
+static int btree_fill_child(struct btree_node *parent, int pos, int level)
+{
+	struct btree_node *left = pos > 0 ? parent->slots[pos - 1] : NULL;
+	struct btree_node *right = pos < parent->nr ? parent->slots[pos + 1] : NULL;
+
+	if (left && left->nr > BTREE_MIN_KEYS) {
+		btree_borrow_left(parent, pos, level);
+	} else if (right && right->nr > BTREE_MIN_KEYS) {
+		btree_borrow_right(parent, pos, level);
+	} else if (right) {
+		btree_merge(parent, pos, level);
+	} else {
+		btree_merge(parent, pos - 1, level);
+		pos--;
+	}
+	return pos;
+}
+
+/* Remove @key and return its value, or NULL if it is not in the tree */
+void *btree_remove(struct btree *tree, int key)
+{
+	struct btree_node *node = tree->root;
+	void *value = NULL;
+	int level, pos;
+
+	if (!node)
+		return NULL;
+
+	for (level = tree->height; level > 0; level--) {
+		pos = btree_child_slot(node, key);
+		if (((struct btree_node *)node->slots[pos])->nr <= BTREE_MIN_KEYS)
+			pos = btree_fill_child(node, pos, level - 1);
+		node = node->slots[pos];
+	}
+
+	pos = btree_leaf_slot(node, key);
+	if (pos < node->nr && node->keys[pos] == key) {
+		value = node->slots[pos];
+		memmove(node->keys + pos, node->keys + pos + 1, (node->nr - pos - 1) * sizeof(int));
+		memmove(node->slots + pos, node->slots + pos + 1, (node->nr - pos - 1) * sizeof(void *));
+		node->nr--;
+		tree->count--;
+	}
+
+	/* A merge below the root may have left it a single child */
+	node = tree->root;
+	if (tree->height && node->nr == 0) {
+		tree->root = node->slots[0];
+		tree->height--;
+		free(node);
+	} else if (!tree->height && node->nr == 0) {
+		tree->root = NULL;
+		free(node);
+	}
+	return value;
+}
+
+static void btree_destroy_node(struct btree_node *node, int level)
+{
+	int i;
+
+	if (level > 0)
+		for (i = 0; i <= node->nr; i++)
+			btree_destroy_node(node->slots[i], level - 1);
+	free(node);
+}
+
+/* Free every node; the values are the caller's */
+void btree_destroy(struct btree *tree)
+{
+	if (tree->root)
+		btree_destroy_node(tree->root, tree->height);
+	*tree = BTREE_INIT;
+}
+
+static unsigned long btree_count_node(const struct btree_node *node, int level)
+{
+	unsigned long count = 1;
+	int i;
+
+	if (level > 0)
+		for (i = 0; i <= node->nr; i++)
+			count += btree_count_node(node->slots[i], level - 1);
+	return count;
+}
+
+/* Nodes in use, inner ones included; each takes sizeof(struct btree_node) */
+unsigned long btree_node_count(const struct btree *tree)
+{
+	return tree->root ? btree_count_node(tree->root, tree->height) : 0;
+}
+
+bool btree_first(const struct btree *tree, struct btree_iter *iter)
+{
+	struct btree_node *node = tree->root;
+	int level;
+
+	iter->leaf = NULL;
+	iter->slot = 0;
+	if (!node)
+		return false;
+
+	for (level = tree->height; level > 0; level--)
+		node = node->slots[0];
+	iter->leaf = node;
+	return true;
+}
+
+bool btree_next(struct btree_iter *iter)
+{
+	if (++iter->slot < iter->leaf->nr)
+		return true;
+	iter->leaf = iter->leaf->slots[BTREE_NEXT_LEAF];
+	iter->slot = 0;
+	return iter->leaf != NULL;
+}
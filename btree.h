@@ -0,0 +1,102 @@
+/*
+ * Cache-conscious B+tree mapping int keys to pointers
+ *
+ * An rbtree or AVL lookup touches one node, and so usually one cache
+ * line, per level: about log2(n) lines, 20 or more at a million keys.
+ * Here every node holds up to BTREE_KEYS keys, and a lookup reads the
+ * keys of a node from a single cache line and then picks one of up to
+ * BTREE_KEYS + 1 children, so the tree is 4 to 5 times shallower.
+ *
+ * The values live in the leaves, and each leaf links to the next one, so
+ * btree_first()/btree_next() walk the keys in order like rb_first() and
+ * rb_next().  Inner nodes only hold separator keys: child i covers the
+ * keys from keys[i - 1] up to, but not including, keys[i].
+ *
+ * Insertion splits full nodes and removal refills nodes with too few keys
+ * on the way down, so both finish in one root-to-leaf pass without parent
+ * pointers.  Values must not be NULL, which btree_lookup() uses for "not
+ * found".
+ *
+ * btree_lookup() finds the child to descend to with a SIMD compare of the
+ * key against every key of the node at once and a movemask, instead of a
+ * loop of compares.  The kernel is picked at startup from what the CPU
+ * supports; btree_set_search() overrides that, for benchmarks.
+ */
+
+#ifndef _BTREE_H
+#define _BTREE_H
+
+#include <stdbool.h>
+
+/*
+ * Keys per node, 8 to 32.  With 15, the keys and the key count fill the
+ * first cache line of a node exactly, and the 16 child pointers the next
+ * two.
+ */
+#ifndef BTREE_KEYS
+#define BTREE_KEYS		15
+#endif
+
+#if BTREE_KEYS < 8 || BTREE_KEYS > 32
+#error "BTREE_KEYS must be between 8 and 32"
+#endif
+
+/* Every node but the root keeps at least this many keys */
+#define BTREE_MIN_KEYS		(BTREE_KEYS / 2 - 1)
+
+#define BTREE_CACHELINE		64
+
+struct btree_node
+{
+	int keys[BTREE_KEYS];
+	int nr;				/* keys in use */
+	/* Children; in a leaf, the values and (last) the next leaf */
+	void *slots[BTREE_KEYS + 1];
+} __attribute__((aligned(BTREE_CACHELINE)));
+
+struct btree
+{
+	struct btree_node *root;
+	int height;			/* inner levels above the leaves */
+	unsigned long count;
+};
+
+#define BTREE_INIT (struct btree) { NULL, 0, 0 }
+
+struct btree_iter
+{
+	struct btree_node *leaf;
+	int slot;
+};
+
+enum btree_search
+{
+	BTREE_SEARCH_AUTO,		/* the best one the CPU supports */
+	BTREE_SEARCH_SCALAR,
+	BTREE_SEARCH_SSE2,
+	BTREE_SEARCH_AVX2,
+};
+
+/* Returns 0, or -EOPNOTSUPP; not safe against concurrent lookups */
+extern int btree_set_search(enum btree_search search);
+
+extern void *btree_lookup(const struct btree *tree, int key);
+extern int btree_insert(struct btree *tree, int key, void *value);
+extern void *btree_remove(struct btree *tree, int key);
+extern void btree_destroy(struct btree *tree);
+extern unsigned long btree_node_count(const struct btree *tree);
+
+extern bool btree_first(const struct btree *tree, struct btree_iter *iter);
+extern bool btree_next(struct btree_iter *iter);
+
+static inline int btree_iter_key(const struct btree_iter *iter)
+{
+	return iter->leaf->keys[iter->slot];
+}
+
+static inline void *btree_iter_value(const struct btree_iter *iter)
+{
+	return iter->leaf->slots[iter->slot];
+}
+
+#endif	/* _BTREE_H */
@@ -0,0 +1,42 @@
+/*
+ * Interval trees
+ *
+ * An augmented rbtree of closed intervals [start, last], sorted by start,
+ * where every node also tracks the largest 'last' in its subtree.  That
+ * lets interval_tree_iter_first()/interval_tree_iter_next() skip whole
+ * subtrees that cannot overlap the query, so enumerating the k intervals
+ * that overlap [start, last] costs O(log n + k) rather than a full
+ * rb_first()/rb_next() scan.
+ *
+ * Embed struct interval_tree_node in your own structure and fill in start
+ * and last before calling interval_tree_insert().
+ */
+
+#ifndef _LINUX_INTERVAL_TREE_H
+#define _LINUX_INTERVAL_TREE_H
+
+#include "rbtree.h"
+
+struct interval_tree_node
+{
+	struct rb_node rb;
+	unsigned long start;	/* Start of interval */
+	unsigned long last;	/* Last location _in_ interval */
+	unsigned long __subtree_last;
+};
+
+extern void
+interval_tree_insert(struct interval_tree_node *node, struct rb_root *root);
+
+extern void
+interval_tree_remove(struct interval_tree_node *node, struct rb_root *root);
+
+extern struct interval_tree_node *
+interval_tree_iter_first(struct rb_root *root,
+			 unsigned long start, unsigned long last);
+
+extern struct interval_tree_node *
+interval_tree_iter_next(struct interval_tree_node *node,
+			unsigned long start, unsigned long last);
+
+#endif	/* _LINUX_INTERVAL_TREE_H */
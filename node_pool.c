@@ -0,0 +1,114 @@
+#include <stdlib.h>
+#include "node_pool.h"
+
+#define NODE_POOL_ALIGN		sizeof(void *)
+#define NODE_POOL_CACHELINE	64
+
+/* Slab header, padded so the first object starts on a cache line */
+struct node_pool_slab
+{
+	struct node_pool_slab *next;
+	char pad[NODE_POOL_CACHELINE - sizeof(struct node_pool_slab *)];
+};
+
+void node_pool_init(struct node_pool *pool, size_t size, size_t per_slab)
+{
+	if (size < sizeof(void *))
+		size = sizeof(void *);
+	pool->size = (size + NODE_POOL_ALIGN - 1) & ~(NODE_POOL_ALIGN - 1);
+	pool->per_slab = per_slab ? per_slab : 1;
+	pool->free = NULL;
+	pool->bump = pool->bump_end = NULL;
+	pool->slabs = NULL;
+	pthread_mutex_init(&pool->lock, NULL);
+}
+
+/* Slow path of node_pool_alloc(): the free list and current slab are empty */
+void *__node_pool_grow(struct node_pool *pool)
+{
+	struct node_pool_slab *slab;
+	void *mem;
+
+	if (posix_memalign(&mem, NODE_POOL_CACHELINE,
+			   sizeof(*slab) + pool->size * pool->per_slab))
+		return NULL;
+
+	slab = mem;
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+	pool->bump = (char *)(slab + 1) + pool->size;
+	pool->bump_end = (char *)(slab + 1) + pool->size * pool->per_slab;
+
+	return slab + 1;
+}
+
+/* Release every object at once; the pool can be used again afterwards */
+void node_pool_free_all(struct node_pool *pool)
+{
+	struct node_pool_slab *slab, *next;
+
+	for (slab = pool->slabs; slab; slab = next) {
+		next = slab->next;
+		free(slab);
+	}
+	pool->free = NULL;
+	pool->bump = pool->bump_end = NULL;
+	pool->slabs = NULL;
+}
+
+void node_pool_destroy(struct node_pool *pool)
+{
+	node_pool_free_all(pool);
+	pthread_mutex_destroy(&pool->lock);
+}
+
+void node_pool_cache_init(struct node_pool_cache *cache, struct node_pool *pool)
+{
+	cache->pool = pool;
+	cache->free = NULL;
+	cache->count = 0;
+}
+
+/* Slow path of node_pool_cache_alloc(): grab a batch from the shared pool */
+void *__node_pool_cache_refill(struct node_pool_cache *cache)
+{
+	struct node_pool *pool = cache->pool;
+	void *obj = NULL;
+	unsigned int i;
+
+	pthread_mutex_lock(&pool->lock);
+	for (i = 0; i < NODE_POOL_BATCH; i++) {
+		void *next = node_pool_alloc(pool);
+		if (!next)
+			break;
+		if (obj) {
+			*(void **)obj = cache->free;
+			cache->free = obj;
+			cache->count++;
+		}
+		obj = next;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return obj;
+}
+
+/* Hand @count cached objects back to the shared pool */
+void __node_pool_cache_drain(struct node_pool_cache *cache, unsigned int count)
+{
+	struct node_pool *pool = cache->pool;
+
+	pthread_mutex_lock(&pool->lock);
+	while (count-- && cache->free) {
+		void *obj = cache->free;
+		cache->free = *(void **)obj;
+		cache->count--;
+		node_pool_free(pool, obj);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void node_pool_cache_flush(struct node_pool_cache *cache)
+{
+	__node_pool_cache_drain(cache, cache->count);
+}
@@ -0,0 +1,99 @@
+/*
+ * Fixed-size node pools
+ *
+ * A node pool hands out objects of one size carved from large slabs, so
+ * tree nodes end up packed next to each other instead of scattered across
+ * the heap, and allocation is a pointer pop rather than a malloc() call.
+ * Freed objects go on a free list threaded through the objects themselves.
+ * node_pool_free_all() releases every object at once, which is how a whole
+ * tree is torn down without walking it.
+ *
+ * The node_pool_alloc()/node_pool_free() fast paths take no lock: a pool
+ * used from several threads must only be accessed through per-thread
+ * struct node_pool_cache instances, which move objects to and from the
+ * shared pool in batches under its lock.
+ */
+
+#ifndef _NODE_POOL_H
+#define _NODE_POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+/* Objects moved between a per-thread cache and its pool at a time */
+#define NODE_POOL_BATCH		64
+
+struct node_pool_slab;
+
+struct node_pool
+{
+	size_t size;			/* object size, rounded up for alignment */
+	size_t per_slab;		/* objects carved from each slab */
+	void *free;			/* free objects, linked through their first word */
+	char *bump, *bump_end;		/* untouched tail of the newest slab */
+	struct node_pool_slab *slabs;
+	pthread_mutex_t lock;		/* only taken by the per-thread caches */
+};
+
+struct node_pool_cache
+{
+	struct node_pool *pool;
+	void *free;
+	unsigned int count;
+};
+
+extern void node_pool_init(struct node_pool *pool, size_t size, size_t per_slab);
+extern void node_pool_free_all(struct node_pool *pool);
+extern void node_pool_destroy(struct node_pool *pool);
+extern void *__node_pool_grow(struct node_pool *pool);
+
+static inline void *node_pool_alloc(struct node_pool *pool)
+{
+	void *obj = pool->free;
+
+	if (obj) {
+		pool->free = *(void **)obj;
+		return obj;
+	}
+	if (pool->bump < pool->bump_end) {
+		obj = pool->bump;
+		pool->bump += pool->size;
+		return obj;
+	}
+	return __node_pool_grow(pool);
+}
+
+static inline void node_pool_free(struct node_pool *pool, void *obj)
+{
+	*(void **)obj = pool->free;
+	pool->free = obj;
+}
+
+extern void node_pool_cache_init(struct node_pool_cache *cache,
+				 struct node_pool *pool);
+extern void node_pool_cache_flush(struct node_pool_cache *cache);
+extern void *__node_pool_cache_refill(struct node_pool_cache *cache);
+extern void __node_pool_cache_drain(struct node_pool_cache *cache,
+				    unsigned int count);
+
+static inline void *node_pool_cache_alloc(struct node_pool_cache *cache)
+{
+	void *obj = cache->free;
+
+	if (obj) {
+		cache->free = *(void **)obj;
+		cache->count--;
+		return obj;
+	}
+	return __node_pool_cache_refill(cache);
+}
+
+static inline void node_pool_cache_free(struct node_pool_cache *cache, void *obj)
+{
+	*(void **)obj = cache->free;
+	cache->free = obj;
+	if (++cache->count > 2 * NODE_POOL_BATCH)
+		__node_pool_cache_drain(cache, NODE_POOL_BATCH);
+}
+
+#endif	/* _NODE_POOL_H */
@@ -0,0 +1,123 @@
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perf_counters.h"
+
+const char *const perf_counter_names[PERF_NR_COUNTERS] = {
+	[PERF_COUNT_CACHE_MISSES]	= "cache-misses",
+	[PERF_COUNT_LLC_LOADS]		= "LLC-loads",
+	[PERF_COUNT_DTLB_MISSES]	= "dTLB-load-misses",
+	[PERF_COUNT_BRANCH_MISSES]	= "branch-misses",
+	[PERF_COUNT_INSTRUCTIONS]	= "instructions",
+};
+
+#define HW_CACHE(cache, op, result) \
+	((cache) | ((op) << 8) | ((result) << 16))
+
+static const struct {
+	uint32_t type;
+	uint64_t config;
+} perf_counter_events[PERF_NR_COUNTERS] = {
+	[PERF_COUNT_CACHE_MISSES]	= { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	[PERF_COUNT_LLC_LOADS]		= { PERF_TYPE_HW_CACHE,
+					    HW_CACHE(PERF_COUNT_HW_CACHE_LL,
+						     PERF_COUNT_HW_CACHE_OP_READ,
+						     PERF_COUNT_HW_CACHE_RESULT_ACCESS) },
+	[PERF_COUNT_DTLB_MISSES]	= { PERF_TYPE_HW_CACHE,
+					    HW_CACHE(PERF_COUNT_HW_CACHE_DTLB,
+						     PERF_COUNT_HW_CACHE_OP_READ,
+						     PERF_COUNT_HW_CACHE_RESULT_MISS) },
+	[PERF_COUNT_BRANCH_MISSES]	= { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	[PERF_COUNT_INSTRUCTIONS]	= { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+};
+
+/* What read() returns with the read_format below */
+struct perf_read_value {
+	uint64_t value;
+	uint64_t time_enabled;
+	uint64_t time_running;
+};
+
+static int perf_event_open(struct perf_event_attr *attr, pid_t pid, int cpu,
+			   int group_fd, unsigned long flags)
+{
+	return syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+int perf_counters_open(struct perf_counters *pc)
+{
+	struct perf_event_attr attr;
+	int i, opened = 0;
+
+	for (i = 0; i < PERF_NR_COUNTERS; i++) {
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = perf_counter_events[i].type;
+		attr.config = perf_counter_events[i].config;
+		attr.disabled = 1;
+		/* User space only: allowed at perf_event_paranoid 2 */
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+				   PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		pc->fd[i] = perf_event_open(&attr, 0, -1, -1, 0);
+		pc->count[i] = 0;
+		if (pc->fd[i] >= 0)
+			opened++;
+	}
+	return opened;
+}
+
+void perf_counters_close(struct perf_counters *pc)
+{
+	int i;
+
+	for (i = 0; i < PERF_NR_COUNTERS; i++) {
+		if (pc->fd[i] >= 0)
+			close(pc->fd[i]);
+		pc->fd[i] = -1;
+	}
+}
+
+void perf_counters_start(struct perf_counters *pc)
+{
+	int i;
+
+	for (i = 0; i < PERF_NR_COUNTERS; i++) {
+		if (pc->fd[i] < 0)
+			continue;
+		ioctl(pc->fd[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(pc->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+void perf_counters_stop(struct perf_counters *pc)
+{
+	struct perf_read_value v;
+	int i;
+
+	for (i = 0; i < PERF_NR_COUNTERS; i++) {
+		if (pc->fd[i] < 0)
+			continue;
+		ioctl(pc->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+	}
+
+	for (i = 0; i < PERF_NR_COUNTERS; i++) {
+		if (pc->fd[i] < 0)
+			continue;
+		if (read(pc->fd[i], &v, sizeof(v)) != sizeof(v)) {
+			/* Treat a counter that stops reading as unavailable */
+			close(pc->fd[i]);
+			pc->fd[i] = -1;
+			continue;
+		}
+		/* Scale up if the event was multiplexed with others */
+		if (v.time_running && v.time_running < v.time_enabled)
+			v.value = (uint64_t)((double)v.value * v.time_enabled / v.time_running);
+		pc->count[i] += v.value;
+	}
+}
@@ -0,0 +1,73 @@
+/*
+ * In-process hardware event counters
+ *
+ * Thin wrapper around perf_event_open(2) that counts events for the
+ * calling thread over exactly the code between perf_counters_start() and
+ * perf_counters_stop(), so cache behaviour is attributed to the tree
+ * operations being measured rather than to a separately launched process:
+ *
+ *	struct perf_counters pc;
+ *
+ *	perf_counters_open(&pc);
+ *	perf_counters_start(&pc);
+ *	for (i = 0; i < n; i++)
+ *		lookup(tree, keys[i]);
+ *	perf_counters_stop(&pc);
+ *	misses = perf_counter_read(&pc, PERF_COUNT_CACHE_MISSES);
+ *	perf_counters_close(&pc);
+ *
+ * Each event is opened on its own, so a CPU or container that lacks some
+ * of them (or forbids perf_event_open() altogether) still gets the rest.
+ * Unavailable events read as -1; start/stop on them are no-ops.
+ */
+
+#ifndef _PERF_COUNTERS_H
+#define _PERF_COUNTERS_H
+
+#include <stdint.h>
+
+enum perf_counter_id {
+	PERF_COUNT_CACHE_MISSES,
+	PERF_COUNT_LLC_LOADS,
+	PERF_COUNT_DTLB_MISSES,
+	PERF_COUNT_BRANCH_MISSES,
+	PERF_COUNT_INSTRUCTIONS,
+	PERF_NR_COUNTERS
+};
+
+struct perf_counters
+{
+	int fd[PERF_NR_COUNTERS];		/* -1 if the event could not be opened */
+	uint64_t count[PERF_NR_COUNTERS];	/* summed over start/stop pairs */
+};
+
+extern const char *const perf_counter_names[PERF_NR_COUNTERS];
+
+/* Returns the number of events that could be opened */
+extern int perf_counters_open(struct perf_counters *pc);
+extern void perf_counters_close(struct perf_counters *pc);
+
+extern void perf_counters_start(struct perf_counters *pc);
+extern void perf_counters_stop(struct perf_counters *pc);
+
+static inline void perf_counters_clear(struct perf_counters *pc)
+{
+	int i;
+
+	for (i = 0; i < PERF_NR_COUNTERS; i++)
+		pc->count[i] = 0;
+}
+
+static inline int perf_counter_available(const struct perf_counters *pc,
+					 enum perf_counter_id id)
+{
+	return pc->fd[id] >= 0;
+}
+
+static inline long long perf_counter_read(const struct perf_counters *pc,
+					  enum perf_counter_id id)
+{
+	return perf_counter_available(pc, id) ? (long long)pc->count[id] : -1;
+}
+
+#endif	/* _PERF_COUNTERS_H */
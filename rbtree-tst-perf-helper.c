@@ -0,0 +1,323 @@
+// Standalone workload runner for profiling one tree operation at a time
+// under perf, valgrind or cachegrind:
+//
+//   ./rbtree-tst-perf-helper <operation> <node_count> [distribution] [tree] [allocator]
+//
+// It builds a tree of node_count keys (unless the operation is insert,
+// which is the build), then runs the operation once over every key.  The
+// hardware counters of that second phase alone are printed on stderr.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rbtree.h"
+#include "avltree.h"
+#include "avl.h"
+#include "btree.h"
+#include "node_pool.h"
+#include "bench.h"
+#include "perf_counters.h"
+
+enum operation { OP_INSERT, OP_SEARCH, OP_DELETE };
+enum distribution { DIST_RANDOM, DIST_SEQUENTIAL, DIST_REVERSE };
+enum tree_type { TREE_RB, TREE_AVL, TREE_AVL_ITERATIVE, TREE_INTRUSIVE_AVL, TREE_BTREE };
+
+static const char* operation_names[] = { "insert", "search", "delete" };
+static const char* distribution_names[] = { "random", "sequential", "reverse" };
+static const char* tree_names[] = { "rb", "avl", "avl-iter", "iavl", "btree" };
+static const char* allocator_names[] = { "malloc", "pool" };
+
+struct my_node {
+    int key;
+    struct rb_node rb;
+};
+
+struct my_avl_node {
+    int key;
+    struct avl_node avl;
+};
+
+// Node allocation: malloc, or the node pool when use_node_pool is set
+static struct node_pool pool;
+static int use_node_pool = 0;
+
+static void *alloc_node(size_t size) {
+    if (use_node_pool)
+        return node_pool_alloc(&pool);
+    return malloc(size);
+}
+
+static void free_node(void *node) {
+    if (use_node_pool)
+        node_pool_free(&pool, node);
+    else
+        free(node);
+}
+
+static struct rb_node *rb_search(struct rb_root *root, int key) {
+    struct rb_node *node = root->rb_node;
+
+    while (node) {
+        struct my_node *data = rb_entry(node, struct my_node, rb);
+
+        if (key < data->key)
+            node = node->rb_left;
+        else if (key > data->key)
+            node = node->rb_right;
+        else
+            return node;
+    }
+    return NULL;
+}
+
+static void rb_insert(struct rb_root *root, struct my_node *data) {
+    struct rb_node **new = &(root->rb_node), *parent = NULL;
+
+    while (*new) {
+        parent = *new;
+        if (data->key < rb_entry(parent, struct my_node, rb)->key)
+            new = &((*new)->rb_left);
+        else
+            new = &((*new)->rb_right);
+    }
+
+    rb_link_node(&data->rb, parent, new);
+    rb_insert_color(&data->rb, root);
+}
+
+static struct avl_node *iavl_search(struct avl_root *root, int key) {
+    struct avl_node *node = root->avl_node;
+
+    while (node) {
+        struct my_avl_node *data = avl_entry(node, struct my_avl_node, avl);
+
+        if (key < data->key)
+            node = node->avl_left;
+        else if (key > data->key)
+            node = node->avl_right;
+        else
+            return node;
+    }
+    return NULL;
+}
+
+static void iavl_insert(struct avl_root *root, struct my_avl_node *data) {
+    struct avl_node **new = &(root->avl_node), *parent = NULL;
+
+    while (*new) {
+        parent = *new;
+        if (data->key < avl_entry(parent, struct my_avl_node, avl)->key)
+            new = &((*new)->avl_left);
+        else
+            new = &((*new)->avl_right);
+    }
+
+    avl_link_node(&data->avl, parent, new);
+    avl_insert_rebalance(&data->avl, root);
+}
+
+static void generate_keys(int* keys, int n, enum distribution dist) {
+    for (int i = 0; i < n; i++)
+        keys[i] = dist == DIST_REVERSE ? n - 1 - i : i;
+
+    if (dist != DIST_RANDOM)
+        return;
+    for (int i = n - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int temp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = temp;
+    }
+}
+
+static int lookup(const char* name, const char** names, int count) {
+    for (int i = 0; i < count; i++)
+        if (strcmp(name, names[i]) == 0)
+            return i;
+    return -1;
+}
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s <operation> <node_count> [distribution] [tree] [allocator]\n", prog);
+    fprintf(stderr, "  operation:    insert | search | delete\n");
+    fprintf(stderr, "  distribution: random (default) | sequential | reverse\n");
+    fprintf(stderr, "  tree:         rb (default) | avl | avl-iter | iavl | btree\n");
+    fprintf(stderr, "  allocator:    malloc (default) | pool\n");
+}
+
+static void run_rbtree(enum operation op, const int* keys, int n, struct perf_counters* pc) {
+    struct rb_root tree = RB_ROOT;
+    struct my_node** nodes = malloc(n * sizeof(struct my_node*));
+
+    if (op != OP_INSERT) {
+        for (int i = 0; i < n; i++) {
+            nodes[i] = alloc_node(sizeof(struct my_node));
+            nodes[i]->key = keys[i];
+            rb_insert(&tree, nodes[i]);
+        }
+    }
+
+    perf_counters_start(pc);
+    if (op == OP_INSERT) {
+        for (int i = 0; i < n; i++) {
+            nodes[i] = alloc_node(sizeof(struct my_node));
+            nodes[i]->key = keys[i];
+            rb_insert(&tree, nodes[i]);
+        }
+    } else if (op == OP_SEARCH) {
+        for (int i = 0; i < n; i++)
+            bench_do_not_optimize(rb_search(&tree, keys[i]));
+    } else {
+        for (int i = 0; i < n; i++) {
+            rb_erase(&nodes[i]->rb, &tree);
+            free_node(nodes[i]);
+        }
+    }
+    perf_counters_stop(pc);
+
+    if (op != OP_DELETE)
+        for (int i = 0; i < n; i++)
+            free_node(nodes[i]);
+    free(nodes);
+}
+
+static void run_avltree(enum operation op, const int* keys, int n, int iterative, struct perf_counters* pc) {
+    Node* (*insert)(AVLTree, Type) = iterative ? iterative_avltree_insert : avltree_insert;
+    Node* (*delete)(AVLTree, Type) = iterative ? iterative_avltree_delete : avltree_delete;
+    AVLTree tree = NULL;
+
+    if (op != OP_INSERT)
+        for (int i = 0; i < n; i++)
+            tree = insert(tree, keys[i]);
+
+    perf_counters_start(pc);
+    if (op == OP_INSERT) {
+        for (int i = 0; i < n; i++)
+            tree = insert(tree, keys[i]);
+    } else if (op == OP_SEARCH) {
+        for (int i = 0; i < n; i++)
+            bench_do_not_optimize(iterative_avltree_search(tree, keys[i]));
+    } else {
+        for (int i = 0; i < n; i++)
+            tree = delete(tree, keys[i]);
+    }
+    perf_counters_stop(pc);
+
+    destroy_avltree(tree);
+}
+
+static void run_intrusive_avl(enum operation op, const int* keys, int n, struct perf_counters* pc) {
+    struct avl_root tree = AVL_ROOT;
+    struct my_avl_node** nodes = malloc(n * sizeof(struct my_avl_node*));
+
+    if (op != OP_INSERT) {
+        for (int i = 0; i < n; i++) {
+            nodes[i] = alloc_node(sizeof(struct my_avl_node));
+            nodes[i]->key = keys[i];
+            iavl_insert(&tree, nodes[i]);
+        }
+    }
+
+    perf_counters_start(pc);
+    if (op == OP_INSERT) {
+        for (int i = 0; i < n; i++) {
+            nodes[i] = alloc_node(sizeof(struct my_avl_node));
+            nodes[i]->key = keys[i];
+            iavl_insert(&tree, nodes[i]);
+        }
+    } else if (op == OP_SEARCH) {
+        for (int i = 0; i < n; i++)
+            bench_do_not_optimize(iavl_search(&tree, keys[i]));
+    } else {
+        for (int i = 0; i < n; i++) {
+            avl_erase(&nodes[i]->avl, &tree);
+            free_node(nodes[i]);
+        }
+    }
+    perf_counters_stop(pc);
+
+    if (op != OP_DELETE)
+        for (int i = 0; i < n; i++)
+            free_node(nodes[i]);
+    free(nodes);
+}
+
+// The B+tree allocates its own nodes, so the allocator argument is ignored
+static void run_btree(enum operation op, const int* keys, int n, struct perf_counters* pc) {
+    struct btree tree = BTREE_INIT;
+
+    if (op != OP_INSERT)
+        for (int i = 0; i < n; i++)
+            btree_insert(&tree, keys[i], (void*)&keys[i]);
+
+    perf_counters_start(pc);
+    if (op == OP_INSERT) {
+        for (int i = 0; i < n; i++)
+            btree_insert(&tree, keys[i], (void*)&keys[i]);
+    } else if (op == OP_SEARCH) {
+        for (int i = 0; i < n; i++)
+            bench_do_not_optimize(btree_lookup(&tree, keys[i]));
+    } else {
+        for (int i = 0; i < n; i++)
+            btree_remove(&tree, keys[i]);
+    }
+    perf_counters_stop(pc);
+
+    btree_destroy(&tree);
+}
+
+int main(int argc, char* argv[]) {
+    int op, n, dist = DIST_RANDOM, tree = TREE_RB, allocator = 0;
+    struct perf_counters pc;
+
+    if (argc < 3 || argc > 6) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    op = lookup(argv[1], operation_names, ARRAY_SIZE(operation_names));
+    n = atoi(argv[2]);
+    if (argc > 3)
+        dist = lookup(argv[3], distribution_names, ARRAY_SIZE(distribution_names));
+    if (argc > 4)
+        tree = lookup(argv[4], tree_names, ARRAY_SIZE(tree_names));
+    if (argc > 5)
+        allocator = lookup(argv[5], allocator_names, ARRAY_SIZE(allocator_names));
+    if (op < 0 || n <= 0 || dist < 0 || tree < 0 || allocator < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int* keys = malloc(n * sizeof(int));
+    generate_keys(keys, n, dist);
+
+    use_node_pool = allocator;
+    if (tree == TREE_AVL || tree == TREE_AVL_ITERATIVE) {
+        node_pool_init(&pool, sizeof(Node), 4096);
+        avltree_set_node_pool(use_node_pool ? &pool : NULL);
+    } else {
+        node_pool_init(&pool, tree == TREE_RB ? sizeof(struct my_node) : sizeof(struct my_avl_node), 4096);
+    }
+
+    perf_counters_open(&pc);
+    if (tree == TREE_RB)
+        run_rbtree(op, keys, n, &pc);
+    else if (tree == TREE_INTRUSIVE_AVL)
+        run_intrusive_avl(op, keys, n, &pc);
+    else if (tree == TREE_BTREE)
+        run_btree(op, keys, n, &pc);
+    else
+        run_avltree(op, keys, n, tree == TREE_AVL_ITERATIVE, &pc);
+
+    fprintf(stderr, "%s %d %s %s %s\n", operation_names[op], n, distribution_names[dist],
+            tree_names[tree], allocator_names[allocator]);
+    for (int i = 0; i < PERF_NR_COUNTERS; i++)
+        fprintf(stderr, "%20lld %s\n", perf_counter_read(&pc, i), perf_counter_names[i]);
+    perf_counters_close(&pc);
+
+    avltree_set_node_pool(NULL);
+    node_pool_destroy(&pool);
+    free(keys);
+    return 0;
+}
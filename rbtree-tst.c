@@ -2,12 +2,21 @@
 #include <stdlib.h>
 #include <time.h>
 #include <sys/resource.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "rbtree.h"
+#include "rbtree_latch.h"
+#include "rbtree_rank.h"
+#include "rbtree_join.h"
+#include "rbtree_layout.h"
+#include "interval_tree.h"
+#include "node_pool.h"
+#include "rcu.h"
+#include "bench.h"
+#include "perf_counters.h"
+#include "results.h"
 
-// Function to measure time in seconds
-double get_time_in_seconds(clock_t start, clock_t end) {
-    return (double)(end - start) / CLOCKS_PER_SEC;
-}
+#define WARMUP_ITERATIONS 2
 
 // Function to measure memory usage in kilobytes
 long get_memory_usage() {
@@ -22,6 +31,23 @@ struct my_node {
     struct rb_node rb;
 };
 
+// Node allocation: malloc, or my_pool while use_node_pool is set
+static struct node_pool my_pool;
+static int use_node_pool = 0;
+
+static struct my_node *alloc_my_node(void) {
+    if (use_node_pool)
+        return node_pool_alloc(&my_pool);
+    return malloc(sizeof(struct my_node));
+}
+
+static void free_my_node(struct my_node *data) {
+    if (use_node_pool)
+        node_pool_free(&my_pool, data);
+    else
+        free(data);
+}
+
 static int comparison_count = 0;
 
 static struct rb_node *my_search(struct rb_root *root, int key) {
@@ -70,7 +96,29 @@ static int my_insert(struct rb_root *root, struct my_node *data) {
 static void my_delete(struct rb_root *root, struct my_node *data) {
     comparison_count = 0;
     rb_erase(&data->rb, root);
-    free(data);
+    free_my_node(data);
+}
+
+static void my_insert_cached(struct rb_root_cached *root, struct my_node *data) {
+    struct rb_node **new = &(root->rb_root.rb_node), *parent = NULL;
+    int leftmost = 1, rightmost = 1;
+
+    // Track whether we only ever went left (new minimum) or right (new maximum)
+    while (*new) {
+        struct my_node *this = rb_entry(*new, struct my_node, rb);
+
+        parent = *new;
+        if (data->key < this->key) {
+            new = &((*new)->rb_left);
+            rightmost = 0;
+        } else {
+            new = &((*new)->rb_right);
+            leftmost = 0;
+        }
+    }
+
+    rb_link_node(&data->rb, parent, new);
+    rb_insert_color_cached(&data->rb, root, leftmost, rightmost);
 }
 
 void generate_gnuplot_script(const char* time_data_filename, const char* rotation_data_filename, const char* cache_data_filename, const char* time_script_filename, const char* rotation_script_filename, const char* cache_script_filename) {
@@ -84,12 +132,12 @@ void generate_gnuplot_script(const char* time_data_filename, const char* rotatio
     fprintf(time_file, "set output 'rbtree_performance_time.png'\n");
     fprintf(time_file, "set title 'Red-Black Tree Performance (Time)'\n");
     fprintf(time_file, "set xlabel 'Node Count'\n");
-    fprintf(time_file, "set ylabel 'Time (s)'\n");
+    fprintf(time_file, "set ylabel 'Time (ns/op)'\n");
     fprintf(time_file, "set key left top\n");
     fprintf(time_file, "set grid\n");
-    fprintf(time_file, "plot '%s' using 1:2 title 'Insertion Time' with lines,\\\n", time_data_filename);
-    fprintf(time_file, "     '%s' using 1:3 title 'Search Time' with lines,\\\n", time_data_filename);
-    fprintf(time_file, "     '%s' using 1:4 title 'Deletion Time' with lines\n", time_data_filename);
+    fprintf(time_file, "plot '%s' using 1:2:5 title 'Insertion Time' with yerrorlines,\\\n", time_data_filename);
+    fprintf(time_file, "     '%s' using 1:3:6 title 'Search Time' with yerrorlines,\\\n", time_data_filename);
+    fprintf(time_file, "     '%s' using 1:4:7 title 'Deletion Time' with yerrorlines\n", time_data_filename);
 
     fclose(time_file);
 
@@ -132,49 +180,986 @@ void generate_gnuplot_script(const char* time_data_filename, const char* rotatio
     fclose(cache_file);
 }
 
-void run_perf_command(const char* command) {
-    int ret = system(command);
-    if (ret == -1) {
-        perror("Error running perf command");
-        exit(1);
+// One row of per-operation counter averages; -1 for events that could not be counted
+void print_counters(FILE* file, int n, const char* operation, const struct perf_counters* pc, long ops) {
+    fprintf(file, "%d %s", n, operation);
+    for (int i = 0; i < PERF_NR_COUNTERS; i++) {
+        if (perf_counter_available(pc, i))
+            fprintf(file, " %f", (double)perf_counter_read(pc, i) / ops);
+        else
+            fprintf(file, " -1");
     }
+    fprintf(file, "\n");
+}
+
+// Cache misses of one batch, averaged over @iterations batches; -1 if not counted
+static long long cache_misses_per_batch(const struct perf_counters* pc, int iterations) {
+    long long misses = perf_counter_read(pc, PERF_COUNT_CACHE_MISSES);
+    return misses < 0 ? -1 : misses / iterations;
 }
 
-void measure_cache_misses(const char* operation, int n, long* cache_misses) {
-    char command[256];
-    sprintf(command, "perf stat -e cache-misses ./rbtree-tst-perf-helper %s %d 2>&1 | grep 'cache-misses' | awk '{print $1}'", operation, n);
+void generate_unique_random_keys(int* keys, int n) {
+    for (int i = 0; i < n; i++) {
+        keys[i] = i;
+    }
+
+    for (int i = n - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int temp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = temp;
+    }
+}
 
-    FILE* perf_output = popen(command, "r");
-    if (!perf_output) {
-        perror("Error running perf command");
-        exit(1);
+// Insert and delete with the node allocation inside the timed region, from malloc and from a pool
+void measure_allocator_performance(const char* data_filename, int max_node_count, int step_size, int iterations) {
+    static const char* pool_names[] = { "RBTree", "RBTreePool" };
+    FILE* file = fopen(data_filename, "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
     }
+    // Median ns/op, then the 95% confidence half-widths of their means
+    fprintf(file, "# NodeCount MallocInsertionTime PoolInsertionTime MallocDeletionTime PoolDeletionTime "
+                  "MallocInsertionCI PoolInsertionCI MallocDeletionCI PoolDeletionCI\n");
 
-    char buffer[128];
-    if (fgets(buffer, sizeof(buffer), perf_output) != NULL) {
-        *cache_misses = atol(buffer);
-    } else {
-        *cache_misses = 0; // Default to 0 if parsing fails
+    node_pool_init(&my_pool, sizeof(struct my_node), 4096);
+    double *insert_samples[2], *delete_samples[2];
+    for (int pool = 0; pool < 2; pool++) {
+        insert_samples[pool] = malloc(iterations * sizeof(double));
+        delete_samples[pool] = malloc(iterations * sizeof(double));
     }
 
-    pclose(perf_output);
+    for (int n = step_size; n <= max_node_count; n += step_size) {
+        struct bench_stats insert_stats[2], delete_stats[2];
+        int *keys = malloc(n * sizeof(int));
+        struct my_node **nodes = malloc(n * sizeof(struct my_node *));
+
+        for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+            generate_unique_random_keys(keys, n);
+
+            for (int pool = 0; pool < 2; pool++) {
+                struct rb_root tree = RB_ROOT;
+                uint64_t start, end;
+
+                use_node_pool = pool;
+
+                start = bench_now();
+                for (int i = 0; i < n; i++) {
+                    nodes[i] = alloc_my_node();
+                    nodes[i]->key = keys[i];
+                    my_insert(&tree, nodes[i]);
+                }
+                end = bench_now();
+                if (iter >= 0)
+                    insert_samples[pool][iter] = bench_ns_per_op(start, end, n);
+
+                start = bench_now();
+                for (int i = 0; i < n; i++)
+                    my_delete(&tree, nodes[i]);
+                end = bench_now();
+                if (iter >= 0)
+                    delete_samples[pool][iter] = bench_ns_per_op(start, end, n);
+
+                if (pool)
+                    node_pool_free_all(&my_pool);
+            }
+        }
+
+        for (int pool = 0; pool < 2; pool++) {
+            bench_summarize(insert_samples[pool], iterations, &insert_stats[pool]);
+            bench_summarize(delete_samples[pool], iterations, &delete_stats[pool]);
+            results_add("allocator-insert", pool_names[pool], "shuffled", n, &insert_stats[pool]);
+            results_add("allocator-delete", pool_names[pool], "shuffled", n, &delete_stats[pool]);
+        }
+        fprintf(file, "%d %f %f %f %f %f %f %f %f\n", n,
+                insert_stats[0].median, insert_stats[1].median, delete_stats[0].median, delete_stats[1].median,
+                insert_stats[0].ci95, insert_stats[1].ci95, delete_stats[0].ci95, delete_stats[1].ci95);
+        free(nodes);
+        free(keys);
+    }
+
+    for (int pool = 0; pool < 2; pool++) {
+        free(insert_samples[pool]);
+        free(delete_samples[pool]);
+    }
+    use_node_pool = 0;
+    node_pool_destroy(&my_pool);
+    fclose(file);
 }
 
+// Order-statistic nodes carry their subtree size
+struct my_rank_node {
+    int key;
+    struct rb_rank_node rn;
+};
+
+static void my_rank_insert(struct rb_root *root, struct my_rank_node *data) {
+    struct rb_node **new = &(root->rb_node), *parent = NULL;
+
+    while (*new) {
+        struct my_rank_node *this = rb_entry(*new, struct my_rank_node, rn.rb);
+
+        parent = *new;
+        if (data->key < this->key)
+            new = &((*new)->rb_left);
+        else
+            new = &((*new)->rb_right);
+    }
+
+    rb_rank_insert(&data->rn, parent, new, root);
+}
+
+static struct rb_node *linear_select(struct rb_root *root, int k) {
+    struct rb_node *node = rb_first(root);
+    while (node && k--)
+        node = rb_next(node);
+    return node;
+}
+
+static int linear_rank(struct rb_node *node) {
+    int rank = 0;
+    while ((node = rb_prev(node)) != NULL)
+        rank++;
+    return rank;
+}
+
+// k-th smallest and rank-of queries: subtree sizes vs walking rb_next/rb_prev
+void measure_rank_performance(const char* data_filename, int max_node_count, int step_size, int queries, int iterations) {
+    enum { SELECT, LINEAR_SELECT, RANK, LINEAR_RANK, NR_RANK };
+    static const char* benchmarks[NR_RANK] = { "select", "select", "rank", "rank" };
+    static const char* trees[NR_RANK] = { "RBTreeRank", "LinearWalk", "RBTreeRank", "LinearWalk" };
+    FILE* file = fopen(data_filename, "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    // Median ns/query, then the 95% confidence half-widths of their means
+    fprintf(file, "# NodeCount SelectTime LinearSelectTime RankTime LinearRankTime "
+                  "SelectCI LinearSelectCI RankCI LinearRankCI\n");
+
+    double *samples[NR_RANK];
+    for (int b = 0; b < NR_RANK; b++)
+        samples[b] = malloc(iterations * sizeof(double));
+
+    for (int n = step_size; n <= max_node_count; n += step_size) {
+        struct rb_root tree = RB_ROOT;
+        struct my_rank_node *nodes = malloc(n * sizeof(struct my_rank_node));
+        int *keys = malloc(n * sizeof(int));
+        int *ks = malloc(queries * sizeof(int));
+        struct bench_stats stats[NR_RANK];
+        long checksum = 0, linear_checksum = 0;
+        uint64_t start, end;
+
+        generate_unique_random_keys(keys, n);
+        for (int i = 0; i < n; i++) {
+            nodes[i].key = keys[i];
+            my_rank_insert(&tree, &nodes[i]);
+        }
+        for (int q = 0; q < queries; q++)
+            ks[q] = rand() % n;
+
+        for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+            double t[NR_RANK];
+
+            start = bench_now();
+            for (int q = 0; q < queries; q++)
+                checksum += rb_entry(rb_select(&tree, ks[q]), struct my_rank_node, rn)->key;
+            end = bench_now();
+            t[SELECT] = bench_ns_per_op(start, end, queries);
+
+            start = bench_now();
+            for (int q = 0; q < queries; q++)
+                linear_checksum += rb_entry(linear_select(&tree, ks[q]), struct my_rank_node, rn.rb)->key;
+            end = bench_now();
+            t[LINEAR_SELECT] = bench_ns_per_op(start, end, queries);
+
+            start = bench_now();
+            for (int q = 0; q < queries; q++)
+                checksum += rb_rank(&nodes[ks[q]].rn);
+            end = bench_now();
+            t[RANK] = bench_ns_per_op(start, end, queries);
+
+            start = bench_now();
+            for (int q = 0; q < queries; q++)
+                linear_checksum += linear_rank(&nodes[ks[q]].rn.rb);
+            end = bench_now();
+            t[LINEAR_RANK] = bench_ns_per_op(start, end, queries);
+
+            if (iter >= 0)
+                for (int b = 0; b < NR_RANK; b++)
+                    samples[b][iter] = t[b];
+        }
+
+        // Keys are 0..n-1, so both methods must agree on every answer
+        if (checksum != linear_checksum)
+            fprintf(stderr, "rank/select mismatch at %d nodes\n", n);
+
+        fprintf(file, "%d", n);
+        for (int b = 0; b < NR_RANK; b++) {
+            bench_summarize(samples[b], iterations, &stats[b]);
+            results_add(benchmarks[b], trees[b], "uniform", n, &stats[b]);
+            fprintf(file, " %f", stats[b].median);
+        }
+        for (int b = 0; b < NR_RANK; b++)
+            fprintf(file, " %f", stats[b].ci95);
+        fprintf(file, "\n");
+        free(ks);
+        free(keys);
+        free(nodes);
+    }
+
+    for (int b = 0; b < NR_RANK; b++)
+        free(samples[b]);
+    fclose(file);
+}
+
+// Overlap (stabbing) queries: interval tree iteration vs scanning in start order
+void measure_interval_performance(const char* data_filename, int max_node_count, int step_size, int queries, int iterations) {
+    FILE* file = fopen(data_filename, "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    // Median ns/query, then the 95% confidence half-widths of their means
+    fprintf(file, "# NodeCount IntervalTreeQueryTime LinearScanQueryTime IntervalTreeQueryCI LinearScanQueryCI\n");
+
+    double *tree_samples = malloc(iterations * sizeof(double));
+    double *linear_samples = malloc(iterations * sizeof(double));
+
+    for (int n = step_size; n <= max_node_count; n += step_size) {
+        struct rb_root tree = RB_ROOT;
+        struct interval_tree_node *nodes = malloc(n * sizeof(struct interval_tree_node));
+        unsigned long *qstart = malloc(queries * sizeof(unsigned long));
+        struct bench_stats tree_stats, linear_stats;
+        long hits = 0, linear_hits = 0;
+        uint64_t start, end;
+
+        // Short ranges scattered over a space ten times the node count
+        for (int i = 0; i < n; i++) {
+            nodes[i].start = rand() % (10UL * n);
+            nodes[i].last = nodes[i].start + rand() % 100;
+            interval_tree_insert(&nodes[i], &tree);
+        }
+        for (int q = 0; q < queries; q++)
+            qstart[q] = rand() % (10UL * n);
+
+        for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+            start = bench_now();
+            for (int q = 0; q < queries; q++) {
+                struct interval_tree_node *it;
+                for (it = interval_tree_iter_first(&tree, qstart[q], qstart[q] + 50); it;
+                     it = interval_tree_iter_next(it, qstart[q], qstart[q] + 50))
+                    hits++;
+            }
+            end = bench_now();
+            if (iter >= 0)
+                tree_samples[iter] = bench_ns_per_op(start, end, queries);
+
+            start = bench_now();
+            for (int q = 0; q < queries; q++) {
+                for (struct rb_node *rb = rb_first(&tree); rb; rb = rb_next(rb)) {
+                    struct interval_tree_node *it = rb_entry(rb, struct interval_tree_node, rb);
+                    if (it->start > qstart[q] + 50)
+                        break;
+                    if (it->last >= qstart[q])
+                        linear_hits++;
+                }
+            }
+            end = bench_now();
+            if (iter >= 0)
+                linear_samples[iter] = bench_ns_per_op(start, end, queries);
+        }
+
+        if (hits != linear_hits)
+            fprintf(stderr, "interval overlap mismatch at %d nodes\n", n);
+
+        bench_summarize(tree_samples, iterations, &tree_stats);
+        bench_summarize(linear_samples, iterations, &linear_stats);
+        results_add("interval-query", "IntervalTree", "stabbing", n, &tree_stats);
+        results_add("interval-query", "LinearScan", "stabbing", n, &linear_stats);
+        fprintf(file, "%d %f %f %f %f\n", n, tree_stats.median, linear_stats.median,
+                tree_stats.ci95, linear_stats.ci95);
+        free(qstart);
+        free(nodes);
+    }
+
+    free(linear_samples);
+    free(tree_samples);
+    fclose(file);
+}
+
+// Priority-queue usage: pop the minimum and requeue it behind everything else
+void measure_cached_first(const char* data_filename, int max_node_count, int step_size, int iterations) {
+    FILE* file = fopen(data_filename, "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    // Median ns per pop and requeue, then the 95% confidence half-widths of their means
+    fprintf(file, "# NodeCount RbFirstPopTime RbFirstCachedPopTime RbFirstPopCI RbFirstCachedPopCI\n");
+
+    double *samples = malloc(iterations * sizeof(double));
+    double *cached_samples = malloc(iterations * sizeof(double));
+
+    for (int n = step_size; n <= max_node_count; n += step_size) {
+        struct bench_stats stats, cached_stats;
+        struct my_node *nodes = malloc(n * sizeof(struct my_node));
+
+        for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+            struct rb_root tree = RB_ROOT;
+            struct rb_root_cached cached = RB_ROOT_CACHED;
+            uint64_t start, end;
+
+            for (int i = 0; i < n; i++) {
+                nodes[i].key = i;
+                my_insert(&tree, &nodes[i]);
+            }
+            start = bench_now();
+            for (int i = 0; i < n; i++) {
+                struct my_node *min = rb_entry(rb_first(&tree), struct my_node, rb);
+                rb_erase(&min->rb, &tree);
+                min->key += n;
+                my_insert(&tree, min);
+            }
+            end = bench_now();
+            if (iter >= 0)
+                samples[iter] = bench_ns_per_op(start, end, n);
+
+            for (int i = 0; i < n; i++) {
+                nodes[i].key = i;
+                my_insert_cached(&cached, &nodes[i]);
+            }
+            start = bench_now();
+            for (int i = 0; i < n; i++) {
+                struct my_node *min = rb_entry(rb_first_cached(&cached), struct my_node, rb);
+                rb_erase_cached(&min->rb, &cached);
+                min->key += n;
+                my_insert_cached(&cached, min);
+            }
+            end = bench_now();
+            if (iter >= 0)
+                cached_samples[iter] = bench_ns_per_op(start, end, n);
+        }
+
+        free(nodes);
+        bench_summarize(samples, iterations, &stats);
+        bench_summarize(cached_samples, iterations, &cached_stats);
+        results_add("pop-min", "RBTree", "sequential", n, &stats);
+        results_add("pop-min", "RBTreeCached", "sequential", n, &cached_stats);
+        fprintf(file, "%d %f %f %f %f\n", n, stats.median, cached_stats.median, stats.ci95, cached_stats.ci95);
+    }
+
+    free(cached_samples);
+    free(samples);
+    fclose(file);
+}
+
+static int my_node_cmp(const struct rb_node *a, const struct rb_node *b) {
+    int ka = rb_entry(a, struct my_node, rb)->key, kb = rb_entry(b, struct my_node, rb)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+// Link nodes[0..n-1], whose keys are ascending, into a fresh tree
+static void build_sorted_tree(struct rb_root *root, struct my_node *nodes, struct rb_node **links, int n) {
+    for (int i = 0; i < n; i++)
+        links[i] = &nodes[i].rb;
+    *root = RB_ROOT;
+    rb_build_sorted(links, n, root);
+}
+
+// Black height of the subtree at @node, or -1 if a red node has a red child,
+// the black heights differ or a parent link is wrong
+static int check_rbtree(const struct rb_node *node, const struct rb_node *parent) {
+    int left, right;
+
+    if (!node)
+        return 1;
+    if (rb_parent(node) != parent)
+        return -1;
+    if (rb_is_red(node) && ((node->rb_left && rb_is_red(node->rb_left)) ||
+                            (node->rb_right && rb_is_red(node->rb_right))))
+        return -1;
+    left = check_rbtree(node->rb_left, node);
+    right = check_rbtree(node->rb_right, node);
+    if (left < 0 || left != right)
+        return -1;
+    return left + rb_is_black(node);
+}
+
+// Does @root hold exactly the @count ascending keys of @expected, as a valid rbtree?
+static int tree_matches(struct rb_root *root, const int *expected, int count) {
+    struct rb_node *rb = rb_first(root);
+
+    for (int i = 0; i < count; i++, rb = rb_next(rb))
+        if (!rb || rb_entry(rb, struct my_node, rb)->key != expected[i])
+            return 0;
+    if (rb || (root->rb_node && rb_is_red(root->rb_node)))
+        return 0;
+    return check_rbtree(root->rb_node, NULL) > 0;
+}
+
+// Keys of the big tree (the even ones below 2n) merged with those of the
+// m small ones: in both (@op '&'), in either ('|') or only in the big tree ('-')
+static int expected_keys(int *out, int n, const struct my_node *small, int m, char op) {
+    int count = 0, i = 0, j = 0;
+
+    while (i < n || j < m) {
+        int big_key = i < n ? 2 * i : -1, small_key = j < m ? small[j].key : -1;
+
+        if (j == m || (i < n && big_key < small_key)) {
+            if (op != '&')
+                out[count++] = big_key;
+            i++;
+        } else if (i == n || small_key < big_key) {
+            if (op == '|')
+                out[count++] = small_key;
+            j++;
+        } else {
+            if (op != '-')
+                out[count++] = big_key;
+            i++;
+            j++;
+        }
+    }
+    return count;
+}
+
+// Merging a small tree of m keys into one of n: join-based set operations
+// vs node-by-node updates, and a split of the big tree around each small key
+// joined straight back.  Every result is checked against the expected keys.
+void measure_set_operations(const char* data_filename, int n, int iterations) {
+    enum {
+        JOIN_UNION, INSERT_UNION, JOIN_INTERSECTION, SEARCH_INTERSECTION,
+        JOIN_DIFFERENCE, ERASE_DIFFERENCE, SPLIT_JOIN, NR_SET_OPS
+    };
+    static const char* benchmarks[NR_SET_OPS] = {
+        "set-union", "set-union", "set-intersection", "set-intersection",
+        "set-difference", "set-difference", "split-join"
+    };
+    static const char* trees[NR_SET_OPS] = {
+        "RBTreeJoin", "RBTreeInsert", "RBTreeJoin", "RBTreeSearch", "RBTreeJoin", "RBTreeErase", "RBTreeJoin"
+    };
+    FILE* file = fopen(data_filename, "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    // Median ns per key of the small tree (per split and join for SplitJoin),
+    // then the 95% confidence half-widths of their means
+    fprintf(file, "# SmallTreeSize JoinUnionTime InsertUnionTime JoinIntersectionTime SearchIntersectionTime "
+                  "JoinDifferenceTime EraseDifferenceTime SplitJoinTime "
+                  "JoinUnionCI InsertUnionCI JoinIntersectionCI SearchIntersectionCI "
+                  "JoinDifferenceCI EraseDifferenceCI SplitJoinCI\n");
+
+    struct my_node *big = malloc(n * sizeof(struct my_node));
+    struct my_node *small = malloc(n * sizeof(struct my_node));
+    struct rb_node **links = malloc(n * sizeof(struct rb_node *));
+    int *expected = malloc(2 * n * sizeof(int));
+    double *samples[NR_SET_OPS];
+    char workload[32];
+
+    for (int op = 0; op < NR_SET_OPS; op++)
+        samples[op] = malloc(iterations * sizeof(double));
+    snprintf(workload, sizeof(workload), "into=%d", n);
+
+    // The big tree holds the even keys below 2n
+    for (int i = 0; i < n; i++)
+        big[i].key = 2 * i;
+
+    for (int m = 16; m <= n; m *= 4) {
+        struct bench_stats stats[NR_SET_OPS];
+        int mismatches = 0;
+
+        for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+            struct rb_root a, b, result;
+            struct rb_node *mid;
+            uint64_t start, end;
+            double t[NR_SET_OPS];
+            int count;
+
+            // m distinct keys below 2n in ascending order (selection sampling), half of them in the big tree
+            for (int k = 0, picked = 0; picked < m; k++)
+                if (rand() % (2 * n - k) < m - picked)
+                    small[picked++].key = k;
+
+            count = expected_keys(expected, n, small, m, '|');
+            build_sorted_tree(&a, big, links, n);
+            build_sorted_tree(&b, small, links, m);
+            start = bench_now();
+            rb_union(&a, &b, my_node_cmp, NULL, NULL);
+            end = bench_now();
+            t[JOIN_UNION] = bench_ns_per_op(start, end, m);
+            mismatches += !tree_matches(&a, expected, count);
+
+            build_sorted_tree(&a, big, links, n);
+            start = bench_now();
+            for (int i = 0; i < m; i++)
+                my_insert(&a, &small[i]);
+            end = bench_now();
+            t[INSERT_UNION] = bench_ns_per_op(start, end, m);
+            mismatches += !tree_matches(&a, expected, count);
+
+            count = expected_keys(expected, n, small, m, '&');
+            build_sorted_tree(&a, big, links, n);
+            build_sorted_tree(&b, small, links, m);
+            start = bench_now();
+            rb_intersection(&a, &b, my_node_cmp, NULL, NULL);
+            end = bench_now();
+            t[JOIN_INTERSECTION] = bench_ns_per_op(start, end, m);
+            mismatches += !tree_matches(&a, expected, count);
+
+            build_sorted_tree(&a, big, links, n);
+            result = RB_ROOT;
+            start = bench_now();
+            for (int i = 0; i < m; i++)
+                if (my_search(&a, small[i].key))
+                    my_insert(&result, &small[i]);
+            end = bench_now();
+            t[SEARCH_INTERSECTION] = bench_ns_per_op(start, end, m);
+            mismatches += !tree_matches(&result, expected, count);
+
+            count = expected_keys(expected, n, small, m, '-');
+            build_sorted_tree(&a, big, links, n);
+            build_sorted_tree(&b, small, links, m);
+            start = bench_now();
+            rb_difference(&a, &b, my_node_cmp, NULL, NULL);
+            end = bench_now();
+            t[JOIN_DIFFERENCE] = bench_ns_per_op(start, end, m);
+            mismatches += !tree_matches(&a, expected, count);
+
+            build_sorted_tree(&a, big, links, n);
+            start = bench_now();
+            for (int i = 0; i < m; i++) {
+                struct rb_node *rb = my_search(&a, small[i].key);
+                if (rb)
+                    rb_erase(rb, &a);
+            }
+            end = bench_now();
+            t[ERASE_DIFFERENCE] = bench_ns_per_op(start, end, m);
+            mismatches += !tree_matches(&a, expected, count);
+
+            // One split checked on its own: the keys below small[0] stay, those above move
+            count = expected_keys(expected, n, small, 0, '|');
+            build_sorted_tree(&a, big, links, n);
+            mid = rb_split(&a, &small[0].rb, my_node_cmp, &b);
+            int below = (small[0].key + 1) / 2, above = n - below - (mid != NULL);
+            mismatches += (mid != NULL) != (small[0].key % 2 == 0);
+            mismatches += !tree_matches(&a, expected, below);
+            mismatches += !tree_matches(&b, expected + n - above, above);
+            rb_join(&a, mid, &b);
+            mismatches += !tree_matches(&a, expected, count);
+
+            start = bench_now();
+            for (int i = 0; i < m; i++) {
+                mid = rb_split(&a, &small[i].rb, my_node_cmp, &b);
+                rb_join(&a, mid, &b);
+            }
+            end = bench_now();
+            t[SPLIT_JOIN] = bench_ns_per_op(start, end, m);
+            mismatches += !tree_matches(&a, expected, count);
+
+            if (iter >= 0)
+                for (int op = 0; op < NR_SET_OPS; op++)
+                    samples[op][iter] = t[op];
+        }
+
+        if (mismatches)
+            fprintf(stderr, "set operation mismatch at %d nodes\n", m);
+
+        fprintf(file, "%d", m);
+        for (int op = 0; op < NR_SET_OPS; op++) {
+            bench_summarize(samples[op], iterations, &stats[op]);
+            results_add(benchmarks[op], trees[op], workload, m, &stats[op]);
+            fprintf(file, " %f", stats[op].median);
+        }
+        for (int op = 0; op < NR_SET_OPS; op++)
+            fprintf(file, " %f", stats[op].ci95);
+        fprintf(file, "\n");
+    }
+
+    for (int op = 0; op < NR_SET_OPS; op++)
+        free(samples[op]);
+    free(expected);
+    free(links);
+    free(small);
+    free(big);
+    fclose(file);
+}
+
+static long find_add_comparisons = 0;
+
+static int my_find_add_cmp(struct rb_node *a, const struct rb_node *b) {
+    int ka = rb_entry(a, struct my_node, rb)->key, kb = rb_entry(b, struct my_node, rb)->key;
+    find_add_comparisons++;
+    return (ka > kb) - (ka < kb);
+}
+
+// Upserts (my_search then my_insert vs one rb_find_add descent) and a
+// near-sorted insert stream (my_insert, rb_find_add, rb_find_add_hint from
+// the previous node): ns and key comparisons per operation
+void measure_find_add(const char* data_filename, int max_node_count, int step_size, int iterations) {
+    FILE* file = fopen(data_filename, "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    // Median times, mean comparisons, then the 95% confidence half-widths of the mean times
+    fprintf(file, "# NodeCount UpsertSearchInsertTime UpsertFindAddTime UpsertSearchInsertCmps UpsertFindAddCmps "
+                  "SortedInsertTime SortedFindAddTime SortedHintTime SortedInsertCmps SortedFindAddCmps SortedHintCmps "
+                  "UpsertSearchInsertCI UpsertFindAddCI SortedInsertCI SortedFindAddCI SortedHintCI\n");
+
+    enum { SEARCH_INSERT, FIND_ADD, SORTED_INSERT, SORTED_FIND_ADD, SORTED_HINT, NR_FIND_ADD };
+    static const char* benchmarks[NR_FIND_ADD] = { "upsert", "upsert", "sorted-insert", "sorted-insert", "sorted-insert" };
+    static const char* trees[NR_FIND_ADD] = {
+        "RBTreeSearchInsert", "RBTreeFindAdd", "RBTreeInsert", "RBTreeFindAdd", "RBTreeFindAddHint"
+    };
+    static const char* workloads[NR_FIND_ADD] = { "uniform", "uniform", "near-sorted", "near-sorted", "near-sorted" };
+    double *samples[NR_FIND_ADD];
+
+    for (int method = 0; method < NR_FIND_ADD; method++)
+        samples[method] = malloc(iterations * sizeof(double));
+
+    for (int n = step_size; n <= max_node_count; n += step_size) {
+        struct bench_stats stats[NR_FIND_ADD];
+        long comparisons[NR_FIND_ADD] = { 0 };
+        struct my_node *nodes = malloc(2 * n * sizeof(struct my_node));
+        int *upserts = malloc(n * sizeof(int));
+        int *sorted = malloc(n * sizeof(int));
+
+        for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+            long cmps[NR_FIND_ADD] = { 0 };
+            double t[NR_FIND_ADD];
+            uint64_t start, end;
+
+            // Half of the upserted keys are already in the tree of n/2 even keys
+            for (int i = 0; i < n; i++) {
+                upserts[i] = rand() % n;
+                // Ascending, but each key may swap places with its neighbours
+                sorted[i] = 4 * i + rand() % 8;
+            }
+
+            for (int method = SEARCH_INSERT; method <= FIND_ADD; method++) {
+                struct rb_root tree = RB_ROOT;
+                int used = n / 2;
+
+                for (int i = 0; i < n / 2; i++) {
+                    nodes[i].key = 2 * i;
+                    my_insert(&tree, &nodes[i]);
+                }
+                find_add_comparisons = 0;
+                start = bench_now();
+                for (int i = 0; i < n; i++) {
+                    struct my_node *data = &nodes[used];
+
+                    data->key = upserts[i];
+                    if (method == SEARCH_INSERT) {
+                        if (!my_search(&tree, upserts[i])) {
+                            cmps[method] += comparison_count;
+                            my_insert(&tree, data);
+                            used++;
+                        }
+                        cmps[method] += comparison_count;
+                    } else if (!rb_find_add(&data->rb, &tree, my_find_add_cmp)) {
+                        used++;
+                    }
+                }
+                end = bench_now();
+                t[method] = bench_ns_per_op(start, end, n);
+                if (method == FIND_ADD)
+                    cmps[method] += find_add_comparisons;
+            }
+
+            for (int method = SORTED_INSERT; method <= SORTED_HINT; method++) {
+                struct rb_root tree = RB_ROOT;
+                struct rb_node *hint = NULL, *existing;
+
+                find_add_comparisons = 0;
+                start = bench_now();
+                for (int i = 0; i < n; i++) {
+                    struct my_node *data = &nodes[i];
+
+                    data->key = sorted[i];
+                    if (method == SORTED_INSERT) {
+                        my_insert(&tree, data);
+                        cmps[method] += comparison_count;
+                    } else if (method == SORTED_FIND_ADD) {
+                        rb_find_add(&data->rb, &tree, my_find_add_cmp);
+                    } else {
+                        existing = rb_find_add_hint(&data->rb, &tree, hint, my_find_add_cmp);
+                        hint = existing ? existing : &data->rb;
+                    }
+                }
+                end = bench_now();
+                t[method] = bench_ns_per_op(start, end, n);
+                if (method != SORTED_INSERT)
+                    cmps[method] += find_add_comparisons;
+            }
+
+            if (iter >= 0)
+                for (int method = 0; method < NR_FIND_ADD; method++) {
+                    samples[method][iter] = t[method];
+                    comparisons[method] += cmps[method];
+                }
+        }
+
+        for (int method = 0; method < NR_FIND_ADD; method++) {
+            bench_summarize(samples[method], iterations, &stats[method]);
+            results_add(benchmarks[method], trees[method], workloads[method], n, &stats[method]);
+        }
+        fprintf(file, "%d %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f\n", n,
+                stats[SEARCH_INSERT].median, stats[FIND_ADD].median,
+                (double)comparisons[SEARCH_INSERT] / iterations / n, (double)comparisons[FIND_ADD] / iterations / n,
+                stats[SORTED_INSERT].median, stats[SORTED_FIND_ADD].median, stats[SORTED_HINT].median,
+                (double)comparisons[SORTED_INSERT] / iterations / n, (double)comparisons[SORTED_FIND_ADD] / iterations / n,
+                (double)comparisons[SORTED_HINT] / iterations / n,
+                stats[SEARCH_INSERT].ci95, stats[FIND_ADD].ci95,
+                stats[SORTED_INSERT].ci95, stats[SORTED_FIND_ADD].ci95, stats[SORTED_HINT].ci95);
+        free(sorted);
+        free(upserts);
+        free(nodes);
+    }
+
+    for (int method = 0; method < NR_FIND_ADD; method++)
+        free(samples[method]);
+    fclose(file);
+}
+
+// Lockless lookups: struct latch_node is linked into both latch trees
+struct latch_node {
+    int key;
+    struct latch_tree_node lt;
+};
+
+static int latch_less(struct latch_tree_node *a, struct latch_tree_node *b) {
+    return container_of(a, struct latch_node, lt)->key < container_of(b, struct latch_node, lt)->key;
+}
+
+static int latch_comp(void *key, struct latch_tree_node *b) {
+    int k = *(int *)key, bk = container_of(b, struct latch_node, lt)->key;
+    return k < bk ? -1 : k > bk;
+}
+
+static const struct latch_tree_ops latch_ops = {
+    .less = latch_less,
+    .comp = latch_comp,
+};
+
+struct latch_bench {
+    struct latch_tree_root root;
+    struct latch_node *nodes;
+    int n;
+    long lookups_per_thread;
+    volatile int stop;
+};
+
+static void *latch_reader(void *arg) {
+    struct latch_bench *b = arg;
+    unsigned int seed = (unsigned int)(unsigned long)pthread_self();
+    long found = 0;
+
+    rcu_register_thread();
+    for (long i = 0; i < b->lookups_per_thread; i++) {
+        int key = rand_r(&seed) % b->n;
+        rcu_read_lock();
+        found += latch_tree_find(&key, &b->root, &latch_ops) != NULL;
+        rcu_read_unlock();
+    }
+    rcu_unregister_thread();
+    return (void *)found;
+}
+
+// A rare writer: erase a node, wait for readers, and link it back in
+static void *latch_writer(void *arg) {
+    struct latch_bench *b = arg;
+    unsigned int seed = 1;
+
+    while (!b->stop) {
+        struct latch_node *node = &b->nodes[rand_r(&seed) % b->n];
+        latch_tree_erase(&node->lt, &b->root, &latch_ops);
+        synchronize_rcu();
+        latch_tree_insert(&node->lt, &b->root, &latch_ops);
+        usleep(1000);
+    }
+    return NULL;
+}
+
+void measure_latch_read_scaling(const char* data_filename, int n, int max_threads, int iterations) {
+    FILE* file = fopen(data_filename, "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    // Aggregate lookups per second from the median ns per lookup, then that median and its 95% CI
+    fprintf(file, "# Threads LookupsPerSecond LookupTime LookupCI\n");
+
+    struct latch_bench b = { .root = LATCH_TREE_ROOT, .n = n, .lookups_per_thread = 1000000 };
+    double *samples = malloc(iterations * sizeof(double));
+    b.nodes = malloc(n * sizeof(struct latch_node));
+    for (int i = 0; i < n; i++) {
+        b.nodes[i].key = i;
+        latch_tree_insert(&b.nodes[i].lt, &b.root, &latch_ops);
+    }
+
+    for (int threads = 1; threads <= max_threads; threads++) {
+        pthread_t readers[threads], writer;
+        struct bench_stats stats;
+        char workload[32];
+
+        for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+            b.stop = 0;
+            pthread_create(&writer, NULL, latch_writer, &b);
+            uint64_t start = bench_now();
+            for (int t = 0; t < threads; t++)
+                pthread_create(&readers[t], NULL, latch_reader, &b);
+            for (int t = 0; t < threads; t++)
+                pthread_join(readers[t], NULL);
+            uint64_t end = bench_now();
+            b.stop = 1;
+            pthread_join(writer, NULL);
+
+            if (iter >= 0)
+                samples[iter] = bench_ns_per_op(start, end, threads * b.lookups_per_thread);
+        }
+
+        bench_summarize(samples, iterations, &stats);
+        snprintf(workload, sizeof(workload), "threads=%d", threads);
+        results_add("latch-lookup", "LatchTree", workload, n, &stats);
+        fprintf(file, "%d %f %f %f\n", threads, 1e9 / stats.median, stats.median, stats.ci95);
+    }
+
+    free(b.nodes);
+    free(samples);
+    fclose(file);
+}
+
+static void free_moved_node(void *old, void *new, void *arg) {
+    free(old);
+}
+
+// Random lookups and a full rb_next() walk over @tree, as laid out now;
+// @relayout_time is the ns per node it took to get there
+static void time_layout(FILE* file, const char* layout, struct rb_root* tree, int n,
+                        const int* probes, int lookups, int iterations, double relayout_time) {
+    struct bench_stats search_stats, iterate_stats;
+    double *search_samples = malloc(iterations * sizeof(double));
+    double *iterate_samples = malloc(iterations * sizeof(double));
+    uint64_t start, end;
+
+    for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
+        long sum = 0;
+
+        start = bench_now();
+        for (int i = 0; i < lookups; i++)
+            bench_do_not_optimize(my_search(tree, probes[i]));
+        end = bench_now();
+        if (iter >= 0)
+            search_samples[iter] = bench_ns_per_op(start, end, lookups);
+
+        start = bench_now();
+        for (struct rb_node *rb = rb_first(tree); rb; rb = rb_next(rb))
+            sum += rb_entry(rb, struct my_node, rb)->key;
+        end = bench_now();
+        bench_do_not_optimize(sum);
+        if (iter >= 0)
+            iterate_samples[iter] = bench_ns_per_op(start, end, n);
+    }
+
+    bench_summarize(search_samples, iterations, &search_stats);
+    bench_summarize(iterate_samples, iterations, &iterate_stats);
+    results_add("layout-search", "RBTree", layout, n, &search_stats);
+    results_add("layout-iterate", "RBTree", layout, n, &iterate_stats);
+    fprintf(file, "%s %f %f %f %f %f\n", layout, search_stats.median, iterate_stats.median,
+            relayout_time, search_stats.ci95, iterate_stats.ci95);
+
+    free(iterate_samples);
+    free(search_samples);
+}
+
+// A tree of n malloc'd nodes churned by 4n erase/insert pairs, so that
+// neighbours in the tree are far apart in memory, then copied into an
+// arena in BFS, vEB and in-order layout in turn: ns per random lookup,
+// per rb_next() step and per node relaid
+void measure_relayout(const char* data_filename, int n, int iterations) {
+    static const char* layout_names[] = {
+        [RB_LAYOUT_BFS] = "bfs",
+        [RB_LAYOUT_VEB] = "veb",
+        [RB_LAYOUT_INORDER] = "inorder",
+    };
+    const int lookups = 1 << 20;
+
+    FILE* file = fopen(data_filename, "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return;
+    }
+    fprintf(file, "# Layout SearchTime IterateTime RelayoutTime SearchCI IterateCI\n");
+
+    struct rb_root tree = RB_ROOT;
+    struct my_node **nodes = malloc(n * sizeof(struct my_node *));
+    struct my_node *arena = NULL, *old_arena;
+    int *probes = malloc(lookups * sizeof(int));
+    uint64_t start, end;
+
+    for (int i = 0; i < n; i++) {
+        nodes[i] = malloc(sizeof(struct my_node));
+        do
+            nodes[i]->key = rand();
+        while (!my_insert(&tree, nodes[i]));
+    }
+    for (long i = 0; i < 4L * n; i++) {
+        int victim = rand() % n;
+
+        rb_erase(&nodes[victim]->rb, &tree);
+        free(nodes[victim]);
+        nodes[victim] = malloc(sizeof(struct my_node));
+        do
+            nodes[victim]->key = rand();
+        while (!my_insert(&tree, nodes[victim]));
+    }
+    for (int i = 0; i < lookups; i++)
+        probes[i] = nodes[rand() % n]->key;
+    free(nodes);
+
+    time_layout(file, "churned", &tree, n, probes, lookups, iterations, 0.0);
+
+    for (enum rb_layout layout = RB_LAYOUT_BFS; layout <= RB_LAYOUT_INORDER; layout++) {
+        old_arena = arena;
+        arena = malloc(n * sizeof(struct my_node));
+        start = bench_now();
+        rb_relayout(&tree, arena, sizeof(struct my_node), offsetof(struct my_node, rb),
+                    layout, old_arena ? NULL : free_moved_node, NULL);
+        end = bench_now();
+        free(old_arena);
+
+        time_layout(file, layout_names[layout], &tree, n, probes, lookups, iterations,
+                    bench_ns_per_op(start, end, n));
+    }
+
+    free(arena);
+    free(probes);
+    fclose(file);
+}
 
 int main() {
     struct rb_root tree = RB_ROOT;
-    clock_t start, end;
+    struct rb_stats stats;
+    uint64_t start, end;
     int max_node_count = 5000; // Increase the range for better analysis
     int step_size = 500;
     int iterations = 25; // Increase iterations for more stable results
 
+    // Every measurement also goes to one CSV record, see bench-compare
+    results_open("rbtree_results.csv", "rbtree-tst");
+
     // Print time results to a file
     FILE* time_file = fopen("rbtree_performance_time.dat", "w");
     if (!time_file) {
         perror("Error opening file for writing");
         return 1;
     }
-    fprintf(time_file, "# NodeCount InsertionTime SearchTime DeletionTime\n");
+    // Median ns/op per operation, then the 95% confidence half-widths of their means
+    fprintf(time_file, "# NodeCount InsertionTime SearchTime DeletionTime InsertionCI SearchCI DeletionCI\n");
 
     // Print rotation results to a file
     FILE* rotation_file = fopen("rbtree_performance_rotation.dat", "w");
@@ -192,79 +1177,146 @@ int main() {
     }
     fprintf(cache_file, "# NodeCount InsertionCacheMisses SearchCacheMisses DeletionCacheMisses\n");
 
+    // All hardware counters, per operation, counted in this process around each batch
+    FILE* counters_file = fopen("rbtree_performance_counters.dat", "w");
+    if (!counters_file) {
+        perror("Error opening file for writing");
+        return 1;
+    }
+    fprintf(counters_file, "# NodeCount Operation CacheMisses LLCLoads DTLBMisses BranchMisses Instructions\n");
+
+    struct perf_counters insert_pc, search_pc, delete_pc;
+    perf_counters_open(&insert_pc);
+    perf_counters_open(&search_pc);
+    if (!perf_counters_open(&delete_pc))
+        fprintf(stderr, "perf_event_open unavailable, hardware counters are reported as -1\n");
+
+    double *insert_samples = malloc(iterations * sizeof(double));
+    double *search_samples = malloc(iterations * sizeof(double));
+    double *delete_samples = malloc(iterations * sizeof(double));
+
     for (int n = step_size; n <= max_node_count; n += step_size) {
-        double total_insert_time = 0.0, total_delete_time = 0.0, total_search_time = 0.0;
+        struct bench_stats insert_stats, search_stats, delete_stats;
         long total_insert_rotations = 0, total_search_rotations = 0, total_delete_rotations = 0;
-        long total_insert_cache_misses = 0, total_search_cache_misses = 0, total_delete_cache_misses = 0;
+        long total_deleted = 0;
+        struct my_node **nodes = malloc(n * sizeof(struct my_node *));
+        int* keys = (int*)malloc(n * sizeof(int));
+        int inserted;
 
-        for (int iter = 0; iter < iterations; iter++) {
+        perf_counters_clear(&insert_pc);
+        perf_counters_clear(&search_pc);
+        perf_counters_clear(&delete_pc);
+
+        // Each operation is timed over the whole batch of n keys; the first
+        // WARMUP_ITERATIONS rounds are run but not recorded
+        for (int iter = -WARMUP_ITERATIONS; iter < iterations; iter++) {
             // Generate random keys
-            int* keys = (int*)malloc(n * sizeof(int));
             for (int i = 0; i < n; i++) {
                 keys[i] = rand() % 1000000;
             }
 
-            // Measure insertion time, rotations, and cache misses
+            // Measure insertion time and rotations; duplicate keys are not linked
+            inserted = 0;
+            rb_stats_reset();
+            if (iter >= 0)
+                perf_counters_start(&insert_pc);
+            start = bench_now();
             for (int i = 0; i < n; i++) {
-                struct my_node *new_node = (struct my_node *)malloc(sizeof(struct my_node));
-                new_node->key = keys[i];
-
-                start = clock();
-                reset_rb_rotation_count();
-                my_insert(&tree, new_node);
-                end = clock();
-
-                total_insert_time += get_time_in_seconds(start, end);
-                total_insert_rotations += rb_rotation_count;
+                nodes[i] = (struct my_node *)malloc(sizeof(struct my_node));
+                nodes[i]->key = keys[i];
+                if (my_insert(&tree, nodes[i])) {
+                    inserted++;
+                } else {
+                    free(nodes[i]);
+                    nodes[i] = NULL;
+                }
             }
-            long insert_cache_misses;
-            measure_cache_misses("insert", n, &insert_cache_misses);
-            total_insert_cache_misses += insert_cache_misses;
-
-            // Measure search time, rotations, and cache misses
-            for (int i = 0; i < n; i++) {
-                start = clock();
-                reset_rb_rotation_count();
-                my_search(&tree, keys[i]);
-                end = clock();
-
-                total_search_time += get_time_in_seconds(start, end);
-                total_search_rotations += rb_rotation_count; // This should typically be zero
+            end = bench_now();
+            if (iter >= 0)
+                perf_counters_stop(&insert_pc);
+            rb_stats_read(&stats);
+            if (iter < 0) {
+                for (int i = 0; i < n; i++)
+                    if (nodes[i])
+                        my_delete(&tree, nodes[i]);
+                continue;
             }
-            long search_cache_misses;
-            measure_cache_misses("search", n, &search_cache_misses);
-            total_search_cache_misses += search_cache_misses;
-
-            // Measure deletion time, rotations, and cache misses
-            for (int i = 0; i < n; i++) {
-                struct rb_node *node = my_search(&tree, keys[i]);
-                if (node) {
-                    struct my_node *data = rb_entry(node, struct my_node, rb);
+            insert_samples[iter] = bench_ns_per_op(start, end, n);
+            total_insert_rotations += stats.rotations;
 
-                    start = clock();
-                    reset_rb_rotation_count();
-                    my_delete(&tree, data);
-                    end = clock();
+            // Measure search time and rotations
+            rb_stats_reset();
+            perf_counters_start(&search_pc);
+            start = bench_now();
+            for (int i = 0; i < n; i++)
+                bench_do_not_optimize(my_search(&tree, keys[i]));
+            end = bench_now();
+            perf_counters_stop(&search_pc);
+            rb_stats_read(&stats);
+            search_samples[iter] = bench_ns_per_op(start, end, n);
+            total_search_rotations += stats.rotations; // This should typically be zero
 
-                    total_delete_time += get_time_in_seconds(start, end);
-                    total_delete_rotations += rb_rotation_count;
-                }
-            }
-            long delete_cache_misses;
-            measure_cache_misses("delete", n, &delete_cache_misses);
-            total_delete_cache_misses += delete_cache_misses;
-
-            free(keys);
+            // Measure deletion time and rotations
+            rb_stats_reset();
+            perf_counters_start(&delete_pc);
+            start = bench_now();
+            for (int i = 0; i < n; i++)
+                if (nodes[i])
+                    my_delete(&tree, nodes[i]);
+            end = bench_now();
+            perf_counters_stop(&delete_pc);
+            rb_stats_read(&stats);
+            delete_samples[iter] = bench_ns_per_op(start, end, inserted);
+            total_delete_rotations += stats.rotations;
+            total_deleted += inserted;
         }
+        free(keys);
+        free(nodes);
+
+        bench_summarize(insert_samples, iterations, &insert_stats);
+        bench_summarize(search_samples, iterations, &search_stats);
+        bench_summarize(delete_samples, iterations, &delete_stats);
+        results_add("insert", "RBTree", "random", n, &insert_stats);
+        results_add("search", "RBTree", "random", n, &search_stats);
+        results_add("delete", "RBTree", "random", n, &delete_stats);
 
-        fprintf(time_file, "%d %f %f %f\n", n, total_insert_time / iterations, total_search_time / iterations, total_delete_time / iterations);
+        fprintf(time_file, "%d %f %f %f %f %f %f\n", n, insert_stats.median, search_stats.median, delete_stats.median,
+                insert_stats.ci95, search_stats.ci95, delete_stats.ci95);
         fprintf(rotation_file, "%d %ld %ld %ld\n", n, total_insert_rotations / iterations, total_search_rotations / iterations, total_delete_rotations / iterations);
-        fprintf(cache_file, "%d %ld %ld %ld\n", n, total_insert_cache_misses / iterations, total_search_cache_misses / iterations, total_delete_cache_misses / iterations);
+        fprintf(cache_file, "%d %lld %lld %lld\n", n, cache_misses_per_batch(&insert_pc, iterations),
+                cache_misses_per_batch(&search_pc, iterations), cache_misses_per_batch(&delete_pc, iterations));
+        print_counters(counters_file, n, "insert", &insert_pc, (long)n * iterations);
+        print_counters(counters_file, n, "search", &search_pc, (long)n * iterations);
+        print_counters(counters_file, n, "delete", &delete_pc, total_deleted);
     }
 
+    free(insert_samples);
+    free(search_samples);
+    free(delete_samples);
+    perf_counters_close(&insert_pc);
+    perf_counters_close(&search_pc);
+    perf_counters_close(&delete_pc);
     fclose(time_file);
     fclose(rotation_file);
     fclose(cache_file);
+    fclose(counters_file);
+
+    measure_allocator_performance("rbtree_allocator_time.dat", max_node_count, step_size, iterations);
+
+    measure_cached_first("rbtree_cached_first.dat", max_node_count, step_size, iterations);
+
+    measure_rank_performance("rbtree_rank_time.dat", max_node_count, step_size, 1000, iterations);
+
+    measure_interval_performance("rbtree_interval_time.dat", max_node_count, step_size, 1000, iterations);
+
+    measure_set_operations("rbtree_setops_time.dat", 1 << 20, 5);
+
+    measure_find_add("rbtree_find_add.dat", max_node_count, step_size, iterations);
+
+    measure_relayout("rbtree_relayout.dat", 1 << 21, 5);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    measure_latch_read_scaling("rbtree_latch_scaling.dat", 100000, cpus > 0 ? cpus : 1, 5);
 
     // Generate the gnuplot scripts
     generate_gnuplot_script("rbtree_performance_time.dat", "rbtree_performance_rotation.dat", "rbtree_performance_cache.dat", "rbtree_performance_time.gnuplot", "rbtree_performance_rotation.gnuplot", "rbtree_performance_cache.gnuplot");
@@ -274,5 +1326,7 @@ int main() {
     system("gnuplot rbtree_performance_rotation.gnuplot");
     system("gnuplot rbtree_performance_cache.gnuplot");
 
+    results_close();
+
     return 0;
 }
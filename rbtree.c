@@ -1,59 +1,76 @@
-#include "rbtree.h"
+#include "rbtree_augmented.h"
+
+#ifdef CONFIG_RB_STATS
+__thread struct rb_stats rb_stats;
+
+#define rb_stat_add(field, n)	(rb_stats.field += (n))
+#define rb_stat_depth(depth)						\
+	do {								\
+		if ((depth) > rb_stats.max_fixup_depth)			\
+			rb_stats.max_fixup_depth = (depth);		\
+	} while (0)
+#else
+#define rb_stat_add(field, n)	do { } while (0)
+#define rb_stat_depth(depth)	((void)(depth))
+#endif
 
-unsigned long rb_rotation_count = 0;
-
-void reset_rb_rotation_count(void) {
-    rb_rotation_count = 0;
-}
-
-static void __rb_rotate_left(struct rb_node *node, struct rb_root *root) {
-    rb_rotation_count++; // Increment rotation count
+/*
+ * The rotations hand the augment callback the node that moved down (@node)
+ * and the one that took its place, once both have their final children.
+ */
+static __always_inline void
+__rb_rotate_left(struct rb_node *node, struct rb_root *root,
+		 void (*augment_rotate)(struct rb_node *old, struct rb_node *new)) {
+    rb_stat_add(rotations, 1);
     struct rb_node *right = node->rb_right;
     struct rb_node *parent = rb_parent(node);
+    struct rb_node *tmp = right->rb_left;
 
-    if ((node->rb_right = right->rb_left))
-        rb_set_parent(right->rb_left, node);
-    right->rb_left = node;
+    WRITE_ONCE(node->rb_right, tmp);
+    if (tmp)
+        rb_set_parent(tmp, node);
+    WRITE_ONCE(right->rb_left, node);
 
     rb_set_parent(right, parent);
-
-    if (parent) {
-        if (node == parent->rb_left)
-            parent->rb_left = right;
-        else
-            parent->rb_right = right;
-    } else
-        root->rb_node = right;
+    __rb_change_child(node, right, parent, root);
     rb_set_parent(node, right);
+    augment_rotate(node, right);
 }
 
-static void __rb_rotate_right(struct rb_node *node, struct rb_root *root) {
-    rb_rotation_count++; // Increment rotation count
+static __always_inline void
+__rb_rotate_right(struct rb_node *node, struct rb_root *root,
+		  void (*augment_rotate)(struct rb_node *old, struct rb_node *new)) {
+    rb_stat_add(rotations, 1);
     struct rb_node *left = node->rb_left;
     struct rb_node *parent = rb_parent(node);
+    struct rb_node *tmp = left->rb_right;
 
-    if ((node->rb_left = left->rb_right))
-        rb_set_parent(left->rb_right, node);
-    left->rb_right = node;
+    WRITE_ONCE(node->rb_left, tmp);
+    if (tmp)
+        rb_set_parent(tmp, node);
+    WRITE_ONCE(left->rb_right, node);
 
     rb_set_parent(left, parent);
-
-    if (parent) {
-        if (node == parent->rb_right)
-            parent->rb_right = left;
-        else
-            parent->rb_left = left;
-    } else
-        root->rb_node = left;
+    __rb_change_child(node, left, parent, root);
     rb_set_parent(node, left);
+    augment_rotate(node, left);
 }
 
-void rb_insert_color(struct rb_node *node, struct rb_root *root)
+/*
+ * Returns 1 if the recolouring reached the root, i.e. the black height of
+ * the whole tree grew by one when the root was painted black again.
+ */
+static __always_inline int
+__rb_insert(struct rb_node *node, struct rb_root *root,
+	    void (*augment_rotate)(struct rb_node *old, struct rb_node *new))
 {
 	struct rb_node *parent, *gparent;
+	unsigned long depth = 0;
 
 	while ((parent = rb_parent(node)) && rb_is_red(parent))
 	{
+		rb_stat_add(insert_loops, 1);
+		depth++;
 		gparent = rb_parent(parent);
 
 		if (parent == gparent->rb_left)
@@ -65,6 +82,7 @@ void rb_insert_color(struct rb_node *node, struct rb_root *root)
 					rb_set_black(uncle);
 					rb_set_black(parent);
 					rb_set_red(gparent);
+					rb_stat_add(recolors, 3);
 					node = gparent;
 					continue;
 				}
@@ -73,7 +91,7 @@ void rb_insert_color(struct rb_node *node, struct rb_root *root)
 			if (parent->rb_right == node)
 			{
 				register struct rb_node *tmp;
-				__rb_rotate_left(parent, root);
+				__rb_rotate_left(parent, root, augment_rotate);
 				tmp = parent;
 				parent = node;
 				node = tmp;
@@ -81,7 +99,8 @@ void rb_insert_color(struct rb_node *node, struct rb_root *root)
 
 			rb_set_black(parent);
 			rb_set_red(gparent);
-			__rb_rotate_right(gparent, root);
+			rb_stat_add(recolors, 2);
+			__rb_rotate_right(gparent, root, augment_rotate);
 		} else {
 			{
 				register struct rb_node *uncle = gparent->rb_left;
@@ -90,6 +109,7 @@ void rb_insert_color(struct rb_node *node, struct rb_root *root)
 					rb_set_black(uncle);
 					rb_set_black(parent);
 					rb_set_red(gparent);
+					rb_stat_add(recolors, 3);
 					node = gparent;
 					continue;
 				}
@@ -98,7 +118,7 @@ void rb_insert_color(struct rb_node *node, struct rb_root *root)
 			if (parent->rb_left == node)
 			{
 				register struct rb_node *tmp;
-				__rb_rotate_right(parent, root);
+				__rb_rotate_right(parent, root, augment_rotate);
 				tmp = parent;
 				parent = node;
 				node = tmp;
@@ -106,20 +126,79 @@ void rb_insert_color(struct rb_node *node, struct rb_root *root)
 
 			rb_set_black(parent);
 			rb_set_red(gparent);
-			__rb_rotate_left(gparent, root);
+			rb_stat_add(recolors, 2);
+			__rb_rotate_left(gparent, root, augment_rotate);
 		}
 	}
 
+	rb_stat_depth(depth);
 	rb_set_black(root->rb_node);
+	return !parent;
+}
+
+/*
+ * Non-augmented rbtree manipulation functions.
+ *
+ * We use dummy augmented callbacks here, and have the compiler optimize them
+ * out of the rb_insert_color() and rb_erase() function definitions.
+ */
+
+static inline void dummy_propagate(struct rb_node *node, struct rb_node *stop) {}
+static inline void dummy_copy(struct rb_node *old, struct rb_node *new) {}
+static inline void dummy_rotate(struct rb_node *old, struct rb_node *new) {}
+
+static const struct rb_augment_callbacks dummy_callbacks = {
+	dummy_propagate, dummy_copy, dummy_rotate
+};
+
+void rb_insert_color(struct rb_node *node, struct rb_root *root)
+{
+	__rb_insert(node, root, dummy_rotate);
 }
 
-static void __rb_erase_color(struct rb_node *node, struct rb_node *parent,
-			     struct rb_root *root)
+/*
+ * Augmented rbtree manipulation functions.
+ *
+ * This instantiates the same __always_inline functions as in the
+ * non-augmented case, but this time with user-defined callbacks.
+ */
+
+void __rb_insert_augmented(struct rb_node *node, struct rb_root *root,
+	void (*augment_rotate)(struct rb_node *old, struct rb_node *new))
 {
-	struct rb_node *other;
+	__rb_insert(node, root, augment_rotate);
+}
+
+int __rb_insert_color_bh(struct rb_node *node, struct rb_root *root)
+{
+	return __rb_insert(node, root, dummy_rotate);
+}
+
+void rb_insert_color_cached(struct rb_node *node, struct rb_root_cached *root,
+			    int leftmost, int rightmost)
+{
+	if (leftmost)
+		root->rb_leftmost = node;
+	if (rightmost)
+		root->rb_rightmost = node;
+	rb_insert_color(node, &root->rb_root);
+}
+
+/*
+ * Restore the rbtree properties after a black node without a red child to
+ * take its colour was unlinked below @parent.
+ */
+static __always_inline void
+____rb_erase_color(struct rb_node *parent, struct rb_root *root,
+	void (*augment_rotate)(struct rb_node *old, struct rb_node *new))
+{
+	struct rb_node *node = NULL, *other;
+	unsigned long depth = 0;
 
 	while ((!node || rb_is_black(node)) && node != root->rb_node)
 	{
+		rb_stat_add(erase_loops, 1);
+		depth++;
 		if (parent->rb_left == node)
 		{
 			other = parent->rb_right;
@@ -127,13 +206,15 @@ static void __rb_erase_color(struct rb_node *node, struct rb_node *parent,
 			{
 				rb_set_black(other);
 				rb_set_red(parent);
-				__rb_rotate_left(parent, root);
+				rb_stat_add(recolors, 2);
+				__rb_rotate_left(parent, root, augment_rotate);
 				other = parent->rb_right;
 			}
 			if ((!other->rb_left || rb_is_black(other->rb_left)) &&
 			    (!other->rb_right || rb_is_black(other->rb_right)))
 			{
 				rb_set_red(other);
+				rb_stat_add(recolors, 1);
 				node = parent;
 				parent = rb_parent(node);
 			}
@@ -143,13 +224,15 @@ static void __rb_erase_color(struct rb_node *node, struct rb_node *parent,
 				{
 					rb_set_black(other->rb_left);
 					rb_set_red(other);
-					__rb_rotate_right(other, root);
+					rb_stat_add(recolors, 2);
+					__rb_rotate_right(other, root, augment_rotate);
 					other = parent->rb_right;
 				}
 				rb_set_color(other, rb_color(parent));
 				rb_set_black(parent);
 				rb_set_black(other->rb_right);
-				__rb_rotate_left(parent, root);
+				rb_stat_add(recolors, 3);
+				__rb_rotate_left(parent, root, augment_rotate);
 				node = root->rb_node;
 				break;
 			}
@@ -161,13 +244,15 @@ static void __rb_erase_color(struct rb_node *node, struct rb_node *parent,
 			{
 				rb_set_black(other);
 				rb_set_red(parent);
-				__rb_rotate_right(parent, root);
+				rb_stat_add(recolors, 2);
+				__rb_rotate_right(parent, root, augment_rotate);
 				other = parent->rb_left;
 			}
 			if ((!other->rb_left || rb_is_black(other->rb_left)) &&
 			    (!other->rb_right || rb_is_black(other->rb_right)))
 			{
 				rb_set_red(other);
+				rb_stat_add(recolors, 1);
 				node = parent;
 				parent = rb_parent(node);
 			}
@@ -177,155 +262,81 @@ static void __rb_erase_color(struct rb_node *node, struct rb_node *parent,
 				{
 					rb_set_black(other->rb_right);
 					rb_set_red(other);
-					__rb_rotate_left(other, root);
+					rb_stat_add(recolors, 2);
+					__rb_rotate_left(other, root, augment_rotate);
 					other = parent->rb_left;
 				}
 				rb_set_color(other, rb_color(parent));
 				rb_set_black(parent);
 				rb_set_black(other->rb_left);
-				__rb_rotate_right(parent, root);
+				rb_stat_add(recolors, 3);
+				__rb_rotate_right(parent, root, augment_rotate);
 				node = root->rb_node;
 				break;
 			}
 		}
 	}
+	rb_stat_depth(depth);
 	if (node)
 		rb_set_black(node);
 }
 
-void rb_erase(struct rb_node *node, struct rb_root *root)
+void __rb_erase_color(struct rb_node *parent, struct rb_root *root,
+	void (*augment_rotate)(struct rb_node *old, struct rb_node *new))
 {
-	struct rb_node *child, *parent;
-	int color;
-
-	if (!node->rb_left)
-		child = node->rb_right;
-	else if (!node->rb_right)
-		child = node->rb_left;
-	else
-	{
-		struct rb_node *old = node, *left;
-
-		node = node->rb_right;
-		while ((left = node->rb_left) != NULL)
-			node = left;
-
-		if (rb_parent(old)) {
-			if (rb_parent(old)->rb_left == old)
-				rb_parent(old)->rb_left = node;
-			else
-				rb_parent(old)->rb_right = node;
-		} else
-			root->rb_node = node;
-
-		child = node->rb_right;
-		parent = rb_parent(node);
-		color = rb_color(node);
-
-		if (parent == old) {
-			parent = node;
-		} else {
-			if (child)
-				rb_set_parent(child, parent);
-			parent->rb_left = child;
-
-			node->rb_right = old->rb_right;
-			rb_set_parent(old->rb_right, node);
-		}
-
-		node->rb_parent_color = old->rb_parent_color;
-		node->rb_left = old->rb_left;
-		rb_set_parent(old->rb_left, node);
-
-		goto color;
-	}
-
-	parent = rb_parent(node);
-	color = rb_color(node);
-
-	if (child)
-		rb_set_parent(child, parent);
-	if (parent)
-	{
-		if (parent->rb_left == node)
-			parent->rb_left = child;
-		else
-			parent->rb_right = child;
-	}
-	else
-		root->rb_node = child;
-
- color:
-	if (color == RB_BLACK)
-		__rb_erase_color(child, parent, root);
+	____rb_erase_color(parent, root, augment_rotate);
 }
 
-static void rb_augment_path(struct rb_node *node, rb_augment_f func, void *data)
+void rb_erase(struct rb_node *node, struct rb_root *root)
 {
-	struct rb_node *parent;
-
-up:
-	func(node, data);
-	parent = rb_parent(node);
-	if (!parent)
-		return;
+	struct rb_node *rebalance;
 
-	if (node == parent->rb_left && parent->rb_right)
-		func(parent->rb_right, data);
-	else if (parent->rb_left)
-		func(parent->rb_left, data);
-
-	node = parent;
-	goto up;
+	rebalance = __rb_erase_augmented(node, root, &dummy_callbacks);
+	if (rebalance)
+		____rb_erase_color(rebalance, root, dummy_rotate);
 }
 
-/*
- * after inserting @node into the tree, update the tree to account for
- * both the new entry and any damage done by rebalance
- */
-void rb_augment_insert(struct rb_node *node, rb_augment_f func, void *data)
+void rb_erase_cached(struct rb_node *node, struct rb_root_cached *root)
 {
-	if (node->rb_left)
-		node = node->rb_left;
-	else if (node->rb_right)
-		node = node->rb_right;
-
-	rb_augment_path(node, func, data);
+	if (root->rb_leftmost == node)
+		root->rb_leftmost = rb_next(node);
+	if (root->rb_rightmost == node)
+		root->rb_rightmost = rb_prev(node);
+	rb_erase(node, &root->rb_root);
 }
 
-/*
- * before removing the node, find the deepest node on the rebalance path
- * that will still be there after @node gets removed
- */
-struct rb_node *rb_augment_erase_begin(struct rb_node *node)
+static struct rb_node *__rb_build_sorted(struct rb_node **nodes, size_t n,
+					 struct rb_node *parent, int depth,
+					 int black_depth)
 {
-	struct rb_node *deepest;
-
-	if (!node->rb_right && !node->rb_left)
-		deepest = rb_parent(node);
-	else if (!node->rb_right)
-		deepest = node->rb_left;
-	else if (!node->rb_left)
-		deepest = node->rb_right;
-	else {
-		deepest = rb_next(node);
-		if (deepest->rb_right)
-			deepest = deepest->rb_right;
-		else if (rb_parent(deepest) != node)
-			deepest = rb_parent(deepest);
-	}
+	struct rb_node *node;
+	size_t mid = n / 2;
+
+	if (!n)
+		return NULL;
 
-	return deepest;
+	node = nodes[mid];
+	node->rb_parent_color = (unsigned long)parent |
+				(depth < black_depth ? RB_BLACK : RB_RED);
+	node->rb_left = __rb_build_sorted(nodes, mid, node, depth + 1, black_depth);
+	node->rb_right = __rb_build_sorted(nodes + mid + 1, n - mid - 1, node,
+					   depth + 1, black_depth);
+	return node;
 }
 
-/*
- * after removal, update the tree to account for the removed entry
- * and any rebalance damage.
- */
-void rb_augment_erase_end(struct rb_node *node, rb_augment_f func, void *data)
+void rb_build_sorted(struct rb_node **nodes, size_t n, struct rb_root *root)
 {
-	if (node)
-		rb_augment_path(node, func, data);
+	int black_depth = 0;
+
+	/*
+	 * Splitting at the middle keeps every NULL link at depth
+	 * floor(log2(n + 1)) or one below, so the levels above that are
+	 * complete and black, and the nodes hanging below them are red.
+	 */
+	while (((size_t)2 << black_depth) - 1 <= n)
+		black_depth++;
+
+	root->rb_node = __rb_build_sorted(nodes, n, NULL, 0, black_depth);
 }
 
 /*
@@ -412,20 +423,45 @@ void rb_replace_node(struct rb_node *victim, struct rb_node *new,
 {
 	struct rb_node *parent = rb_parent(victim);
 
+	/* Copy the pointers/colour from the victim to the replacement */
+	*new = *victim;
+
 	/* Set the surrounding nodes to point to the replacement */
-	if (parent) {
-		if (victim == parent->rb_left)
-			parent->rb_left = new;
-		else
-			parent->rb_right = new;
-	} else {
-		root->rb_node = new;
-	}
 	if (victim->rb_left)
 		rb_set_parent(victim->rb_left, new);
 	if (victim->rb_right)
 		rb_set_parent(victim->rb_right, new);
+	__rb_change_child(victim, new, parent, root);
+}
+
+void rb_replace_node_rcu(struct rb_node *victim, struct rb_node *new,
+			 struct rb_root *root)
+{
+	struct rb_node *parent = rb_parent(victim);
 
-	/* Copy the pointers/colour from the victim to the replacement */
 	*new = *victim;
-}
\ No newline at end of file
+
+	if (victim->rb_left)
+		rb_set_parent(victim->rb_left, new);
+	if (victim->rb_right)
+		rb_set_parent(victim->rb_right, new);
+
+	/* Publish only once @new is fully initialised */
+	if (parent) {
+		if (parent->rb_left == victim)
+			rcu_assign_pointer(parent->rb_left, new);
+		else
+			rcu_assign_pointer(parent->rb_right, new);
+	} else
+		rcu_assign_pointer(root->rb_node, new);
+}
+
+void rb_replace_node_cached(struct rb_node *victim, struct rb_node *new,
+			    struct rb_root_cached *root)
+{
+	if (root->rb_leftmost == victim)
+		root->rb_leftmost = new;
+	if (root->rb_rightmost == victim)
+		root->rb_rightmost = new;
+	rb_replace_node(victim, new, &root->rb_root);
+}
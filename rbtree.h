@@ -1,6 +1,13 @@
 #ifndef	_LINUX_RBTREE_H
 #define	_LINUX_RBTREE_H
 
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifndef __always_inline
+  #define __always_inline	inline __attribute__((always_inline))
+#endif
+
 #if defined(container_of)
   #undef container_of
   #define container_of(ptr, type, member) ({			\
@@ -26,6 +33,25 @@
   #define NULL ((void *)0)
 #endif
 
+/*
+ * Accessors for pointers that lockless readers may load concurrently with
+ * an update (see rbtree_latch.h): the compiler must neither tear nor
+ * reorder them, and a newly linked node must be initialised before it is
+ * published.
+ */
+#ifndef WRITE_ONCE
+  #define WRITE_ONCE(x, val)	(*(volatile typeof(x) *)&(x) = (val))
+#endif
+#ifndef READ_ONCE
+  #define READ_ONCE(x)		(*(const volatile typeof(x) *)&(x))
+#endif
+#ifndef rcu_assign_pointer
+  #define rcu_assign_pointer(p, v)	__atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+#endif
+#ifndef rcu_dereference_raw
+  #define rcu_dereference_raw(p)	__atomic_load_n(&(p), __ATOMIC_CONSUME)
+#endif
+
 struct rb_node
 {
 	unsigned long  rb_parent_color;
@@ -41,9 +67,58 @@ struct rb_root
 	struct rb_node *rb_node;
 };
 
+/*
+ * Rebalancing statistics.  With CONFIG_RB_STATS defined the counters live
+ * in thread-local storage, so trees updated from different threads never
+ * share (or race on) a counter.  Without it the hooks in rbtree.c compile
+ * away and rb_stats_read() always reports zeroes.
+ */
+struct rb_stats
+{
+	unsigned long rotations;
+	unsigned long recolors;
+	unsigned long insert_loops;	/* rb_insert_color() fix-up iterations */
+	unsigned long erase_loops;	/* erase fix-up iterations */
+	unsigned long max_fixup_depth;	/* deepest single fix-up, in levels */
+};
+
+#ifdef CONFIG_RB_STATS
+extern __thread struct rb_stats rb_stats;
 
-extern unsigned long rb_rotation_count;
-void reset_rb_rotation_count(void);
+static inline void rb_stats_reset(void)
+{
+	rb_stats = (struct rb_stats) { 0, };
+}
+static inline void rb_stats_read(struct rb_stats *stats)
+{
+	*stats = rb_stats;
+}
+#else
+static inline void rb_stats_reset(void)
+{
+}
+static inline void rb_stats_read(struct rb_stats *stats)
+{
+	*stats = (struct rb_stats) { 0, };
+}
+#endif
+/*
+ * Leftmost- (and optionally rightmost-) cached rbtrees.
+ *
+ * Caching the leftmost node makes rb_first_cached() O(1), which suits
+ * priority-queue style users that keep peeking at or popping the minimum.
+ * The rightmost cache serves max-heaps the same way; it is only kept
+ * up to date when the caller passes @rightmost to rb_insert_color_cached(),
+ * and rb_last_cached() falls back to rb_last() while it is unset.
+ * Rotations never change the in-order sequence, so rebalancing cannot
+ * invalidate either cache.
+ */
+struct rb_root_cached
+{
+	struct rb_root rb_root;
+	struct rb_node *rb_leftmost;
+	struct rb_node *rb_rightmost;
+};
 
 #define rb_parent(r)   ((struct rb_node *)((r)->rb_parent_color & ~3))
 #define rb_color(r)   ((r)->rb_parent_color & 1)
@@ -62,9 +137,11 @@ static inline void rb_set_color(struct rb_node *rb, int color)
 }
 
 #define RB_ROOT	(struct rb_root) { NULL, }
+#define RB_ROOT_CACHED	(struct rb_root_cached) { { NULL, }, NULL, NULL }
 #define	rb_entry(ptr, type, member) container_of(ptr, type, member)
 
 #define RB_EMPTY_ROOT(root)	((root)->rb_node == NULL)
+#define RB_EMPTY_ROOT_CACHED(root)	RB_EMPTY_ROOT(&(root)->rb_root)
 #define RB_EMPTY_NODE(node)	(rb_parent(node) == node)
 #define RB_CLEAR_NODE(node)	(rb_set_parent(node, node))
 
@@ -79,13 +156,17 @@ static inline void rb_init_node(struct rb_node *rb)
 extern void rb_insert_color(struct rb_node *, struct rb_root *);
 extern void rb_erase(struct rb_node *, struct rb_root *);
 
-typedef void (*rb_augment_f)(struct rb_node *node, void *data);
+extern void rb_insert_color_cached(struct rb_node *, struct rb_root_cached *,
+				   int leftmost, int rightmost);
+extern void rb_erase_cached(struct rb_node *, struct rb_root_cached *);
 
-extern void rb_augment_insert(struct rb_node *node,
-			      rb_augment_f func, void *data);
-extern struct rb_node *rb_augment_erase_begin(struct rb_node *node);
-extern void rb_augment_erase_end(struct rb_node *node,
-				 rb_augment_f func, void *data);
+/*
+ * Bulk load: link @nodes, already sorted in tree order, into the empty
+ * tree @root.  Each subtree is rooted at the middle of its range, so the
+ * tree is balanced, and only the partially filled bottom level is red.
+ * O(n), no rotations and no key comparisons.
+ */
+extern void rb_build_sorted(struct rb_node **nodes, size_t n, struct rb_root *root);
 
 /* Find logical next and previous nodes in a tree */
 extern struct rb_node *rb_next(const struct rb_node *);
@@ -93,9 +174,20 @@ extern struct rb_node *rb_prev(const struct rb_node *);
 extern struct rb_node *rb_first(const struct rb_root *);
 extern struct rb_node *rb_last(const struct rb_root *);
 
+#define rb_first_cached(root)	((root)->rb_leftmost)
+
+static inline struct rb_node *rb_last_cached(const struct rb_root_cached *root)
+{
+	return root->rb_rightmost ? root->rb_rightmost : rb_last(&root->rb_root);
+}
+
 /* Fast replacement of a single node without remove/rebalance/add/rebalance */
 extern void rb_replace_node(struct rb_node *victim, struct rb_node *new, 
 			    struct rb_root *root);
+extern void rb_replace_node_rcu(struct rb_node *victim, struct rb_node *new,
+				struct rb_root *root);
+extern void rb_replace_node_cached(struct rb_node *victim, struct rb_node *new,
+				   struct rb_root_cached *root);
 
 static inline void rb_link_node(struct rb_node * node, struct rb_node * parent,
 				struct rb_node ** rb_link)
@@ -106,4 +198,199 @@ static inline void rb_link_node(struct rb_node * node, struct rb_node * parent,
 	*rb_link = node;
 }
 
+static inline void rb_link_node_rcu(struct rb_node * node, struct rb_node * parent,
+				    struct rb_node ** rb_link)
+{
+	node->rb_parent_color = (unsigned long )parent;
+	node->rb_left = node->rb_right = NULL;
+
+	rcu_assign_pointer(*rb_link, node);
+}
+
+/*
+ * Comparator-driven helpers, so users need not open-code the descent.
+ * @cmp and @less see the node being placed first; for rb_find() @cmp
+ * compares an opaque key against a tree node.  All of them are
+ * __always_inline, so the comparator is inlined like a hand-written loop.
+ */
+
+/* Link @node in order of @less; equal nodes go after the existing ones */
+static __always_inline void
+rb_add(struct rb_node *node, struct rb_root *tree,
+       bool (*less)(struct rb_node *, const struct rb_node *))
+{
+	struct rb_node **link = &tree->rb_node;
+	struct rb_node *parent = NULL;
+
+	while (*link) {
+		parent = *link;
+		if (less(node, parent))
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	rb_link_node(node, parent, link);
+	rb_insert_color(node, tree);
+}
+
+/*
+ * Find-or-insert in a single descent: returns the node equal to @node,
+ * or links @node where the descent ended and returns NULL.
+ */
+static __always_inline struct rb_node *
+rb_find_add(struct rb_node *node, struct rb_root *tree,
+	    int (*cmp)(struct rb_node *, const struct rb_node *))
+{
+	struct rb_node **link = &tree->rb_node;
+	struct rb_node *parent = NULL;
+	int c;
+
+	while (*link) {
+		parent = *link;
+		c = cmp(node, parent);
+
+		if (c < 0)
+			link = &parent->rb_left;
+		else if (c > 0)
+			link = &parent->rb_right;
+		else
+			return parent;
+	}
+
+	rb_link_node(node, parent, link);
+	rb_insert_color(node, tree);
+	return NULL;
+}
+
+/*
+ * rb_find_add() starting next to @hint, typically the node added last.
+ * If @node sorts between @hint and its in-order neighbour, one of the two
+ * has a free link on the side facing the other, and @node goes there
+ * after two comparisons; otherwise this falls back to a full descent.
+ * Near-sorted streams thus skip the descent on almost every insertion.
+ */
+static __always_inline struct rb_node *
+rb_find_add_hint(struct rb_node *node, struct rb_root *tree, struct rb_node *hint,
+		 int (*cmp)(struct rb_node *, const struct rb_node *))
+{
+	struct rb_node **link, *parent, *other;
+	int c;
+
+	if (!hint)
+		return rb_find_add(node, tree, cmp);
+
+	c = cmp(node, hint);
+	if (c == 0)
+		return hint;
+
+	if (c > 0) {
+		other = rb_next(hint);
+		if (other && (c = cmp(node, other)) >= 0)
+			return c ? rb_find_add(node, tree, cmp) : other;
+		/* The successor is the leftmost node of a non-empty right subtree */
+		if (!hint->rb_right) {
+			parent = hint;
+			link = &hint->rb_right;
+		} else {
+			parent = other;
+			link = &other->rb_left;
+		}
+	} else {
+		other = rb_prev(hint);
+		if (other && (c = cmp(node, other)) <= 0)
+			return c ? rb_find_add(node, tree, cmp) : other;
+		if (!hint->rb_left) {
+			parent = hint;
+			link = &hint->rb_left;
+		} else {
+			parent = other;
+			link = &other->rb_right;
+		}
+	}
+
+	rb_link_node(node, parent, link);
+	rb_insert_color(node, tree);
+	return NULL;
+}
+
+/* Return the node @cmp reports equal to @key, or NULL */
+static __always_inline struct rb_node *
+rb_find(const void *key, const struct rb_root *tree,
+	int (*cmp)(const void *key, const struct rb_node *))
+{
+	struct rb_node *node = tree->rb_node;
+
+	while (node) {
+		int c = cmp(key, node);
+
+		if (c < 0)
+			node = node->rb_left;
+		else if (c > 0)
+			node = node->rb_right;
+		else
+			return node;
+	}
+
+	return NULL;
+}
+
+/* Descents rb_find_batch() keeps in flight */
+#define RB_BATCH	8
+
+/*
+ * rb_find() for @n keys at once: found[i] is set to the node equal to
+ * keys[i], or NULL.  One descent stalls on a cache miss at every level;
+ * here RB_BATCH descents take turns, each prefetching its next node before
+ * yielding to the others, so their misses overlap.  A finished descent
+ * hands its slot to the next key at once (AMAC, Kocberber et al.), so a
+ * short one does not wait for the rest of its group.  Only the rb_node is
+ * prefetched, so the key @cmp reads should share its cache line.
+ */
+static __always_inline void
+rb_find_batch(const void * const *keys, struct rb_node **found, size_t n,
+	      const struct rb_root *tree,
+	      int (*cmp)(const void *key, const struct rb_node *))
+{
+	struct rb_node *node[RB_BATCH];
+	size_t idx[RB_BATCH], next = 0;
+	int i, nr;
+
+	for (nr = 0; nr < RB_BATCH && next < n; nr++) {
+		idx[nr] = next++;
+		node[nr] = tree->rb_node;
+	}
+
+	while (nr) {
+		for (i = 0; i < nr; i++) {
+			struct rb_node *cur = node[i];
+
+			if (cur) {
+				int c = cmp(keys[idx[i]], cur);
+
+				if (c) {
+					cur = c < 0 ? cur->rb_left : cur->rb_right;
+					if (cur) {
+						__builtin_prefetch(cur);
+						node[i] = cur;
+						continue;
+					}
+				}
+			}
+
+			/* Done with this key: @cur is its node or NULL */
+			found[idx[i]] = cur;
+			if (next < n) {
+				idx[i] = next++;
+				node[i] = tree->rb_node;
+			} else {
+				nr--;
+				idx[i] = idx[nr];
+				node[i] = node[nr];
+				i--;
+			}
+		}
+	}
+}
+
 #endif	/* _LINUX_RBTREE_H */
\ No newline at end of file
@@ -0,0 +1,329 @@
+#include "rbtree32.h"
+
+static inline void
+__rb32_change_child(uint32_t old, uint32_t new, uint32_t parent,
+		    struct rb32_root *root)
+{
+	if (parent) {
+		struct rb32_node *p = rb32_node(root, parent);
+
+		if (p->rb_left == old)
+			p->rb_left = new;
+		else
+			p->rb_right = new;
+	} else
+		root->rb_node = new;
+}
+
+static void __rb32_rotate_left(uint32_t node, struct rb32_root *root)
+{
+	struct rb32_node *n = rb32_node(root, node);
+	uint32_t right = n->rb_right;
+	uint32_t parent = rb32_parent(n);
+	struct rb32_node *r = rb32_node(root, right);
+	uint32_t tmp = r->rb_left;
+
+	n->rb_right = tmp;
+	if (tmp)
+		rb32_set_parent(rb32_node(root, tmp), node);
+	r->rb_left = node;
+
+	rb32_set_parent(r, parent);
+	__rb32_change_child(node, right, parent, root);
+	rb32_set_parent(n, right);
+}
+
+static void __rb32_rotate_right(uint32_t node, struct rb32_root *root)
+{
+	struct rb32_node *n = rb32_node(root, node);
+	uint32_t left = n->rb_left;
+	uint32_t parent = rb32_parent(n);
+	struct rb32_node *l = rb32_node(root, left);
+	uint32_t tmp = l->rb_right;
+
+	n->rb_left = tmp;
+	if (tmp)
+		rb32_set_parent(rb32_node(root, tmp), node);
+	l->rb_right = node;
+
+	rb32_set_parent(l, parent);
+	__rb32_change_child(node, left, parent, root);
+	rb32_set_parent(n, left);
+}
+
+void rb32_insert_color(uint32_t node, struct rb32_root *root)
+{
+	uint32_t parent, gparent, uncle, tmp;
+
+	while ((parent = rb32_parent(rb32_node(root, node))) &&
+	       rb32_is_red(rb32_node(root, parent)))
+	{
+		gparent = rb32_parent(rb32_node(root, parent));
+
+		if (parent == rb32_node(root, gparent)->rb_left)
+		{
+			uncle = rb32_node(root, gparent)->rb_right;
+			if (uncle && rb32_is_red(rb32_node(root, uncle)))
+			{
+				rb32_set_black(rb32_node(root, uncle));
+				rb32_set_black(rb32_node(root, parent));
+				rb32_set_red(rb32_node(root, gparent));
+				node = gparent;
+				continue;
+			}
+
+			if (rb32_node(root, parent)->rb_right == node)
+			{
+				__rb32_rotate_left(parent, root);
+				tmp = parent;
+				parent = node;
+				node = tmp;
+			}
+
+			rb32_set_black(rb32_node(root, parent));
+			rb32_set_red(rb32_node(root, gparent));
+			__rb32_rotate_right(gparent, root);
+		} else {
+			uncle = rb32_node(root, gparent)->rb_left;
+			if (uncle && rb32_is_red(rb32_node(root, uncle)))
+			{
+				rb32_set_black(rb32_node(root, uncle));
+				rb32_set_black(rb32_node(root, parent));
+				rb32_set_red(rb32_node(root, gparent));
+				node = gparent;
+				continue;
+			}
+
+			if (rb32_node(root, parent)->rb_left == node)
+			{
+				__rb32_rotate_right(parent, root);
+				tmp = parent;
+				parent = node;
+				node = tmp;
+			}
+
+			rb32_set_black(rb32_node(root, parent));
+			rb32_set_red(rb32_node(root, gparent));
+			__rb32_rotate_left(gparent, root);
+		}
+	}
+
+	rb32_set_black(rb32_node(root, root->rb_node));
+}
+
+/* An absent child counts as black */
+static inline int rb32_is_black_or_nil(const struct rb32_root *root, uint32_t node)
+{
+	return !node || rb32_is_black(rb32_node(root, node));
+}
+
+/*
+ * Restore the rbtree properties after a black node without a red child to
+ * take its colour was unlinked below @parent.
+ */
+static void __rb32_erase_color(uint32_t parent, struct rb32_root *root)
+{
+	uint32_t node = RB32_NIL, other;
+	struct rb32_node *o;
+
+	while (rb32_is_black_or_nil(root, node) && node != root->rb_node)
+	{
+		if (rb32_node(root, parent)->rb_left == node)
+		{
+			other = rb32_node(root, parent)->rb_right;
+			if (rb32_is_red(rb32_node(root, other)))
+			{
+				rb32_set_black(rb32_node(root, other));
+				rb32_set_red(rb32_node(root, parent));
+				__rb32_rotate_left(parent, root);
+				other = rb32_node(root, parent)->rb_right;
+			}
+			o = rb32_node(root, other);
+			if (rb32_is_black_or_nil(root, o->rb_left) &&
+			    rb32_is_black_or_nil(root, o->rb_right))
+			{
+				rb32_set_red(o);
+				node = parent;
+				parent = rb32_parent(rb32_node(root, node));
+			}
+			else
+			{
+				if (rb32_is_black_or_nil(root, o->rb_right))
+				{
+					rb32_set_black(rb32_node(root, o->rb_left));
+					rb32_set_red(o);
+					__rb32_rotate_right(other, root);
+					other = rb32_node(root, parent)->rb_right;
+					o = rb32_node(root, other);
+				}
+				rb32_set_color(o, rb32_color(rb32_node(root, parent)));
+				rb32_set_black(rb32_node(root, parent));
+				rb32_set_black(rb32_node(root, o->rb_right));
+				__rb32_rotate_left(parent, root);
+				node = root->rb_node;
+				break;
+			}
+		}
+		else
+		{
+			other = rb32_node(root, parent)->rb_left;
+			if (rb32_is_red(rb32_node(root, other)))
+			{
+				rb32_set_black(rb32_node(root, other));
+				rb32_set_red(rb32_node(root, parent));
+				__rb32_rotate_right(parent, root);
+				other = rb32_node(root, parent)->rb_left;
+			}
+			o = rb32_node(root, other);
+			if (rb32_is_black_or_nil(root, o->rb_left) &&
+			    rb32_is_black_or_nil(root, o->rb_right))
+			{
+				rb32_set_red(o);
+				node = parent;
+				parent = rb32_parent(rb32_node(root, node));
+			}
+			else
+			{
+				if (rb32_is_black_or_nil(root, o->rb_left))
+				{
+					rb32_set_black(rb32_node(root, o->rb_right));
+					rb32_set_red(o);
+					__rb32_rotate_left(other, root);
+					other = rb32_node(root, parent)->rb_left;
+					o = rb32_node(root, other);
+				}
+				rb32_set_color(o, rb32_color(rb32_node(root, parent)));
+				rb32_set_black(rb32_node(root, parent));
+				rb32_set_black(rb32_node(root, o->rb_left));
+				__rb32_rotate_right(parent, root);
+				node = root->rb_node;
+				break;
+			}
+		}
+	}
+	if (node)
+		rb32_set_black(rb32_node(root, node));
+}
+
+void rb32_erase(uint32_t node, struct rb32_root *root)
+{
+	struct rb32_node *n = rb32_node(root, node);
+	uint32_t child, parent;
+	int color;
+
+	if (!n->rb_left)
+		child = n->rb_right;
+	else if (!n->rb_right)
+		child = n->rb_left;
+	else
+	{
+		/* Put the successor in @node's place, with its links and colour */
+		uint32_t old = node, left;
+		struct rb32_node *o = n;
+
+		node = o->rb_right;
+		while ((left = rb32_node(root, node)->rb_left) != RB32_NIL)
+			node = left;
+		n = rb32_node(root, node);
+
+		child = n->rb_right;
+		parent = rb32_parent(n);
+		color = rb32_color(n);
+
+		if (parent == old) {
+			parent = node;
+		} else {
+			if (child)
+				rb32_set_parent(rb32_node(root, child), parent);
+			rb32_node(root, parent)->rb_left = child;
+
+			n->rb_right = o->rb_right;
+			rb32_set_parent(rb32_node(root, o->rb_right), node);
+		}
+
+		n->rb_left = o->rb_left;
+		rb32_set_parent(rb32_node(root, o->rb_left), node);
+		n->rb_parent_color = o->rb_parent_color;
+
+		__rb32_change_child(old, node, rb32_parent(o), root);
+		goto color;
+	}
+
+	parent = rb32_parent(n);
+	color = rb32_color(n);
+
+	if (child)
+		rb32_set_parent(rb32_node(root, child), parent);
+	__rb32_change_child(node, child, parent, root);
+
+ color:
+	if (color == RB32_RED)
+		return;
+	/* A lone child of a black node is red: it simply takes its colour */
+	if (child) {
+		rb32_set_black(rb32_node(root, child));
+		return;
+	}
+	if (parent)
+		__rb32_erase_color(parent, root);
+}
+
+uint32_t rb32_first(const struct rb32_root *root)
+{
+	uint32_t n = root->rb_node;
+
+	if (!n)
+		return RB32_NIL;
+	while (rb32_node(root, n)->rb_left)
+		n = rb32_node(root, n)->rb_left;
+	return n;
+}
+
+uint32_t rb32_last(const struct rb32_root *root)
+{
+	uint32_t n = root->rb_node;
+
+	if (!n)
+		return RB32_NIL;
+	while (rb32_node(root, n)->rb_right)
+		n = rb32_node(root, n)->rb_right;
+	return n;
+}
+
+uint32_t rb32_next(const struct rb32_root *root, uint32_t node)
+{
+	uint32_t parent;
+
+	/* Down to the right once, then left as far as we can */
+	if (rb32_node(root, node)->rb_right) {
+		node = rb32_node(root, node)->rb_right;
+		while (rb32_node(root, node)->rb_left)
+			node = rb32_node(root, node)->rb_left;
+		return node;
+	}
+
+	/* Else up until we come from a left child */
+	while ((parent = rb32_parent(rb32_node(root, node))) &&
+	       node == rb32_node(root, parent)->rb_right)
+		node = parent;
+
+	return parent;
+}
+
+uint32_t rb32_prev(const struct rb32_root *root, uint32_t node)
+{
+	uint32_t parent;
+
+	if (rb32_node(root, node)->rb_left) {
+		node = rb32_node(root, node)->rb_left;
+		while (rb32_node(root, node)->rb_right)
+			node = rb32_node(root, node)->rb_right;
+		return node;
+	}
+
+	while ((parent = rb32_parent(rb32_node(root, node))) &&
+	       node == rb32_node(root, parent)->rb_left)
+		node = parent;
+
+	return parent;
+}
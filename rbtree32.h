@@ -0,0 +1,110 @@
+/*
+ * Red-black trees linked by 32-bit indices
+ *
+ * On a 64-bit host a struct rb_node is three pointers, 24 bytes, often
+ * more than the payload it links.  Here every node lives in one arena, an
+ * array of the user's entries, and links to the others by index, so a
+ * struct rb32_node is 12 bytes and twice as many nodes fit in a cache
+ * line or a page.
+ *
+ * As in rb_parent_color, the colour takes the low bit of the parent link
+ * and the parent index the 31 bits above it, so a tree holds at most
+ * RB32_MAX_INDEX nodes.  Index 0 (RB32_NIL) stands for NULL: the first
+ * entry of the arena is never linked.
+ *
+ * The arena is described by its root, so it can be reallocated between
+ * operations without touching any link.  Users write the descent
+ * themselves, as with rbtree.h:
+ *
+ *	uint32_t *link = &root->rb_node, parent = RB32_NIL;
+ *
+ *	while (*link) {
+ *		parent = *link;
+ *		if (key < rb32_entry(root, parent, struct mytype, rb)->key)
+ *			link = &rb32_node(root, parent)->rb_left;
+ *		else
+ *			link = &rb32_node(root, parent)->rb_right;
+ *	}
+ *	rb32_link_node(root, idx, parent, link);
+ *	rb32_insert_color(idx, root);
+ *
+ * rb32_insert_color() and rb32_erase() are the rb_insert_color() and
+ * rb_erase() algorithms, step for step.
+ */
+
+#ifndef _LINUX_RBTREE32_H
+#define _LINUX_RBTREE32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RB32_NIL	0
+#define RB32_MAX_INDEX	((uint32_t)INT32_MAX)
+
+struct rb32_node
+{
+	uint32_t rb_parent_color;
+#define	RB32_RED	0
+#define	RB32_BLACK	1
+	uint32_t rb_right;
+	uint32_t rb_left;
+};
+
+struct rb32_root
+{
+	uint32_t rb_node;
+	char *base;			/* the arena */
+	size_t size;			/* of an entry */
+	size_t offset;			/* of the rb32_node in an entry */
+};
+
+#define RB32_ROOT(base, type, member) \
+	(struct rb32_root) { RB32_NIL, (char *)(base), sizeof(type), offsetof(type, member) }
+
+static inline struct rb32_node *rb32_node(const struct rb32_root *root, uint32_t idx)
+{
+	return (struct rb32_node *)(root->base + idx * root->size + root->offset);
+}
+
+#define rb32_entry(root, idx, type, member) \
+	((type *)((char *)rb32_node(root, idx) - offsetof(type, member)))
+
+#define rb32_parent(r)		((r)->rb_parent_color >> 1)
+#define rb32_color(r)		((r)->rb_parent_color & 1)
+#define rb32_is_red(r)		(!rb32_color(r))
+#define rb32_is_black(r)	rb32_color(r)
+#define rb32_set_red(r)		do { (r)->rb_parent_color &= ~1; } while (0)
+#define rb32_set_black(r)	do { (r)->rb_parent_color |= 1; } while (0)
+
+static inline void rb32_set_parent(struct rb32_node *rb, uint32_t p)
+{
+	rb->rb_parent_color = (rb->rb_parent_color & 1) | (p << 1);
+}
+static inline void rb32_set_color(struct rb32_node *rb, int color)
+{
+	rb->rb_parent_color = (rb->rb_parent_color & ~1) | color;
+}
+
+#define RB32_EMPTY_ROOT(root)	((root)->rb_node == RB32_NIL)
+
+extern void rb32_insert_color(uint32_t node, struct rb32_root *root);
+extern void rb32_erase(uint32_t node, struct rb32_root *root);
+
+/* Find logical next and previous nodes in a tree; RB32_NIL at either end */
+extern uint32_t rb32_next(const struct rb32_root *root, uint32_t node);
+extern uint32_t rb32_prev(const struct rb32_root *root, uint32_t node);
+extern uint32_t rb32_first(const struct rb32_root *root);
+extern uint32_t rb32_last(const struct rb32_root *root);
+
+static inline void rb32_link_node(struct rb32_root *root, uint32_t node,
+				  uint32_t parent, uint32_t *rb_link)
+{
+	struct rb32_node *n = rb32_node(root, node);
+
+	n->rb_parent_color = parent << 1;
+	n->rb_left = n->rb_right = RB32_NIL;
+
+	*rb_link = node;
+}
+
+#endif	/* _LINUX_RBTREE32_H */
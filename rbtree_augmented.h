@@ -0,0 +1,215 @@
+/*
+ * Augmented rbtrees
+ *
+ * An augmented rbtree keeps, in every node, some value that is a function
+ * of the node and its subtree (a subtree size, a maximum end point, ...).
+ * The tree code calls back into the user at the three places where such a
+ * value can go stale:
+ *
+ *  - propagate(node, stop): recompute the value from @node up towards the
+ *    root, stopping at @stop or as soon as a node's value does not change
+ *    (its ancestors then cannot change either);
+ *  - copy(old, new): @new took @old's place in the tree, copy the value;
+ *  - rotate(old, new): a rotation moved @new into @old's place; @new now
+ *    roots @old's former subtree and @old needs recomputing.
+ *
+ * Only rotations on the rebalance path and the nodes on the unlinked path
+ * are ever touched, so an update costs O(1) callbacks amortised instead of
+ * recomputing every node up to the root.
+ *
+ * Please note - only struct rb_augment_callbacks, RB_DECLARE_CALLBACKS()
+ * and the prototypes for rb_insert_augmented() and rb_erase_augmented() are
+ * intended to be public.  The rest are implementation details you don't
+ * want to depend on.
+ */
+
+#ifndef _LINUX_RBTREE_AUGMENTED_H
+#define _LINUX_RBTREE_AUGMENTED_H
+
+#include "rbtree.h"
+
+struct rb_augment_callbacks
+{
+	void (*propagate)(struct rb_node *node, struct rb_node *stop);
+	void (*copy)(struct rb_node *old, struct rb_node *new);
+	void (*rotate)(struct rb_node *old, struct rb_node *new);
+};
+
+extern void __rb_insert_augmented(struct rb_node *node, struct rb_root *root,
+	void (*augment_rotate)(struct rb_node *old, struct rb_node *new));
+
+/*
+ * rb_insert_color() that also reports whether the fix-up grew the black
+ * height of the tree by one (see rbtree_join.c, which tracks it).
+ */
+extern int __rb_insert_color_bh(struct rb_node *node, struct rb_root *root);
+
+/*
+ * Fixup the rbtree and update the augmented information when rebalancing.
+ *
+ * On insertion, the user must update the augmented information on the path
+ * leading to the inserted node, then call rb_link_node() as usual and
+ * rb_insert_augmented() instead of the usual rb_insert_color() call.
+ * If rb_insert_augmented() rebalances the rbtree, it will callback into
+ * a user provided function to update the augmented information on the
+ * affected subtrees.
+ */
+static inline void
+rb_insert_augmented(struct rb_node *node, struct rb_root *root,
+		    const struct rb_augment_callbacks *augment)
+{
+	__rb_insert_augmented(node, root, augment->rotate);
+}
+
+/*
+ * RB_DECLARE_CALLBACKS - template for augmented rbtree callbacks
+ *
+ * rbstatic:    'static' or empty
+ * rbname:      name of the rb_augment_callbacks structure
+ * rbstruct:    struct type of the tree nodes
+ * rbfield:     name of struct rb_node field within rbstruct
+ * rbtype:      type of the augmented field
+ * rbaugmented: name of the augmented field within rbstruct
+ * rbcompute:   name of function that recomputes the rbaugmented data
+ */
+#define RB_DECLARE_CALLBACKS(rbstatic, rbname, rbstruct, rbfield,	\
+			     rbtype, rbaugmented, rbcompute)		\
+static inline void							\
+rbname ## _propagate(struct rb_node *rb, struct rb_node *stop)		\
+{									\
+	while (rb != stop) {						\
+		rbstruct *node = rb_entry(rb, rbstruct, rbfield);	\
+		rbtype augmented = rbcompute(node);			\
+		if (node->rbaugmented == augmented)			\
+			break;						\
+		node->rbaugmented = augmented;				\
+		rb = rb_parent(&node->rbfield);				\
+	}								\
+}									\
+static inline void							\
+rbname ## _copy(struct rb_node *rb_old, struct rb_node *rb_new)		\
+{									\
+	rbstruct *old = rb_entry(rb_old, rbstruct, rbfield);		\
+	rbstruct *new = rb_entry(rb_new, rbstruct, rbfield);		\
+	new->rbaugmented = old->rbaugmented;				\
+}									\
+static void								\
+rbname ## _rotate(struct rb_node *rb_old, struct rb_node *rb_new)	\
+{									\
+	rbstruct *old = rb_entry(rb_old, rbstruct, rbfield);		\
+	rbstruct *new = rb_entry(rb_new, rbstruct, rbfield);		\
+	new->rbaugmented = old->rbaugmented;				\
+	old->rbaugmented = rbcompute(old);				\
+}									\
+rbstatic const struct rb_augment_callbacks rbname = {			\
+	rbname ## _propagate, rbname ## _copy, rbname ## _rotate	\
+};
+
+/*
+ * Child pointers are published with WRITE_ONCE() and every restructuring
+ * is ordered so that, in program order, the tree never contains a
+ * (temporary) loop.  A lockless reader racing with a writer may therefore
+ * miss nodes and must validate its result (see rbtree_latch.h), but it
+ * always reaches a leaf.
+ */
+static inline void __rb_change_child(struct rb_node *old, struct rb_node *new,
+				     struct rb_node *parent, struct rb_root *root)
+{
+	if (parent) {
+		if (parent->rb_left == old)
+			WRITE_ONCE(parent->rb_left, new);
+		else
+			WRITE_ONCE(parent->rb_right, new);
+	} else
+		WRITE_ONCE(root->rb_node, new);
+}
+
+extern void __rb_erase_color(struct rb_node *parent, struct rb_root *root,
+	void (*augment_rotate)(struct rb_node *old, struct rb_node *new));
+
+/*
+ * Unlink @node and update the augmented values on the affected path.
+ * Returns the node below which a black level went missing, or NULL if
+ * no rebalancing is needed.
+ */
+static __always_inline struct rb_node *
+__rb_erase_augmented(struct rb_node *node, struct rb_root *root,
+		     const struct rb_augment_callbacks *augment)
+{
+	struct rb_node *child, *parent;
+	int color;
+
+	if (!node->rb_left)
+		child = node->rb_right;
+	else if (!node->rb_right)
+		child = node->rb_left;
+	else
+	{
+		struct rb_node *old = node, *left;
+
+		node = node->rb_right;
+		while ((left = node->rb_left) != NULL)
+			node = left;
+
+		child = node->rb_right;
+		parent = rb_parent(node);
+		color = rb_color(node);
+
+		/*
+		 * Build the successor's new links before making it reachable
+		 * from old's parent, so lockless readers never see a loop.
+		 */
+		if (parent == old) {
+			parent = node;
+			augment->copy(old, node);
+		} else {
+			if (child)
+				rb_set_parent(child, parent);
+			WRITE_ONCE(parent->rb_left, child);
+
+			WRITE_ONCE(node->rb_right, old->rb_right);
+			rb_set_parent(old->rb_right, node);
+
+			augment->copy(old, node);
+			augment->propagate(parent, node);
+		}
+
+		WRITE_ONCE(node->rb_left, old->rb_left);
+		rb_set_parent(old->rb_left, node);
+		node->rb_parent_color = old->rb_parent_color;
+
+		__rb_change_child(old, node, rb_parent(old), root);
+		augment->propagate(node, NULL);
+
+		goto color;
+	}
+
+	parent = rb_parent(node);
+	color = rb_color(node);
+
+	if (child)
+		rb_set_parent(child, parent);
+	__rb_change_child(node, child, parent, root);
+	augment->propagate(parent, NULL);
+
+ color:
+	if (color == RB_RED)
+		return NULL;
+	/* A lone child of a black node is red: it simply takes its colour */
+	if (child) {
+		rb_set_black(child);
+		return NULL;
+	}
+	return parent;
+}
+
+static __always_inline void
+rb_erase_augmented(struct rb_node *node, struct rb_root *root,
+		   const struct rb_augment_callbacks *augment)
+{
+	struct rb_node *rebalance = __rb_erase_augmented(node, root, augment);
+	if (rebalance)
+		__rb_erase_color(rebalance, root, augment->rotate);
+}
+
+#endif	/* _LINUX_RBTREE_AUGMENTED_H */
@@ -0,0 +1,443 @@
+#include "rbtree_join.h"
+#include "rbtree_augmented.h"
+#include "thread_pool.h"
+
+/*
+ * Recursive calls on subtrees of at least this black height (2^bh - 1
+ * nodes or more) become pool tasks; smaller ones are not worth a fork.
+ */
+#define RB_PARALLEL_BH		10
+
+/* Largest range rb_build_sorted_parallel() builds in one go */
+#define RB_PARALLEL_CHUNK	(1 << 16)
+
+/*
+ * A detached subtree with a black (or no) root, carried around with its
+ * black height so that a join never has to walk down to a leaf to learn
+ * it.  Every function below takes and returns subtrees in this form.
+ */
+struct rb_subtree {
+	struct rb_node *node;
+	int bh;
+};
+
+static struct rb_subtree rb_subtree(const struct rb_root *root)
+{
+	struct rb_subtree t = { root->rb_node, 0 };
+	const struct rb_node *node;
+
+	for (node = root->rb_node; node; node = node->rb_left)
+		t.bh += rb_is_black(node);
+	return t;
+}
+
+/*
+ * Cut @child off its parent, the black root of a subtree of black height
+ * @bh.  A red child becomes a black root, which adds one to its height.
+ */
+static inline struct rb_subtree rb_detach(struct rb_node *child, int bh)
+{
+	struct rb_subtree t = { child, bh - 1 };
+
+	if (child) {
+		if (rb_is_red(child))
+			t.bh++;
+		child->rb_parent_color = RB_BLACK;
+	}
+	return t;
+}
+
+static inline void rb_set_children(struct rb_node *node, struct rb_node *left,
+				   struct rb_node *right)
+{
+	node->rb_left = left;
+	node->rb_right = right;
+	if (left)
+		rb_set_parent(left, node);
+	if (right)
+		rb_set_parent(right, node);
+}
+
+/*
+ * @l is taller: walk down its right spine to the first black node (or
+ * leaf) as high as @r, and put @mid there as a red node with that
+ * subtree and @r as children.  That is an ordinary insertion of a red
+ * node as far as the fix-up is concerned.
+ */
+static struct rb_subtree __rb_join_right(struct rb_subtree l, struct rb_node *mid,
+					 struct rb_subtree r)
+{
+	struct rb_root root = { l.node };
+	struct rb_node *parent = NULL, *node = l.node;
+	int bh = l.bh;
+
+	while (bh > r.bh || (node && rb_is_red(node))) {
+		bh -= rb_is_black(node);
+		parent = node;
+		node = node->rb_right;
+	}
+
+	rb_link_node(mid, parent, &parent->rb_right);
+	rb_set_children(mid, node, r.node);
+	l.bh += __rb_insert_color_bh(mid, &root);
+	l.node = root.rb_node;
+	return l;
+}
+
+static struct rb_subtree __rb_join_left(struct rb_subtree l, struct rb_node *mid,
+					struct rb_subtree r)
+{
+	struct rb_root root = { r.node };
+	struct rb_node *parent = NULL, *node = r.node;
+	int bh = r.bh;
+
+	while (bh > l.bh || (node && rb_is_red(node))) {
+		bh -= rb_is_black(node);
+		parent = node;
+		node = node->rb_left;
+	}
+
+	rb_link_node(mid, parent, &parent->rb_left);
+	rb_set_children(mid, l.node, node);
+	r.bh += __rb_insert_color_bh(mid, &root);
+	r.node = root.rb_node;
+	return r;
+}
+
+/* Everything in @l sorts before @mid, and @mid before everything in @r */
+static struct rb_subtree __rb_join(struct rb_subtree l, struct rb_node *mid,
+				   struct rb_subtree r)
+{
+	struct rb_subtree t = { mid, l.bh + 1 };
+
+	if (l.bh > r.bh)
+		return __rb_join_right(l, mid, r);
+	if (l.bh < r.bh)
+		return __rb_join_left(l, mid, r);
+
+	mid->rb_parent_color = RB_BLACK;
+	rb_set_children(mid, l.node, r.node);
+	return t;
+}
+
+/*
+ * Split @t into the nodes before and after @key.  The node equal to @key,
+ * if any, ends up in neither and is returned.
+ */
+static struct rb_node *__rb_split(struct rb_subtree t, const struct rb_node *key,
+				  rb_cmp_t cmp, struct rb_subtree *l,
+				  struct rb_subtree *r)
+{
+	struct rb_node *node = t.node, *found;
+	struct rb_subtree left, right, tmp;
+	int c;
+
+	if (!node) {
+		*l = *r = t;
+		return NULL;
+	}
+
+	left = rb_detach(node->rb_left, t.bh);
+	right = rb_detach(node->rb_right, t.bh);
+	c = cmp(key, node);
+	if (c < 0) {
+		found = __rb_split(left, key, cmp, l, &tmp);
+		*r = __rb_join(tmp, node, right);
+	} else if (c > 0) {
+		found = __rb_split(right, key, cmp, &tmp, r);
+		*l = __rb_join(left, node, tmp);
+	} else {
+		*l = left;
+		*r = right;
+		found = node;
+	}
+	return found;
+}
+
+/* Take the last node out of the non-empty @t, leaving the others in @rest */
+static struct rb_node *__rb_split_last(struct rb_subtree t, struct rb_subtree *rest)
+{
+	struct rb_node *node = t.node, *last;
+	struct rb_subtree left, right, tmp;
+
+	left = rb_detach(node->rb_left, t.bh);
+	right = rb_detach(node->rb_right, t.bh);
+	if (!right.node) {
+		*rest = left;
+		return node;
+	}
+
+	last = __rb_split_last(right, &tmp);
+	*rest = __rb_join(left, node, tmp);
+	return last;
+}
+
+/* Join without a middle node */
+static struct rb_subtree __rb_join2(struct rb_subtree l, struct rb_subtree r)
+{
+	struct rb_node *last;
+
+	if (!l.node)
+		return r;
+	last = __rb_split_last(l, &l);
+	return __rb_join(l, last, r);
+}
+
+/*
+ * What the set operations pass down their recursion.  @fn is the
+ * operation itself, so rb_setop_recurse() can run either half as a task.
+ */
+struct rb_setop {
+	struct rb_subtree (*fn)(struct rb_subtree a, struct rb_subtree b,
+				const struct rb_setop *op);
+	rb_cmp_t cmp;
+	rb_dispose_t dispose;
+	void *arg;
+};
+
+struct rb_setop_task {
+	struct thread_pool_task task;
+	const struct rb_setop *op;
+	struct rb_subtree a, b, result;
+};
+
+static void rb_setop_run(void *data)
+{
+	struct rb_setop_task *t = data;
+
+	t->result = t->op->fn(t->a, t->b, t->op);
+}
+
+static inline void rb_dispose(struct rb_node *node, const struct rb_setop *op)
+{
+	if (op->dispose)
+		op->dispose(node, op->arg);
+}
+
+static void rb_dispose_tree(struct rb_node *node, const struct rb_setop *op)
+{
+	if (!node || !op->dispose)
+		return;
+	rb_dispose_tree(node->rb_left, op);
+	rb_dispose_tree(node->rb_right, op);
+	op->dispose(node, op->arg);
+}
+
+/*
+ * Split @b around the root of @a and apply the operation to the two pairs
+ * of halves, the left pair as a separate task when it is big enough to be
+ * worth stealing.  Returns the node of @b equal to the root of @a, if any.
+ */
+static struct rb_node *rb_setop_recurse(struct rb_subtree a, struct rb_subtree b,
+					const struct rb_setop *op,
+					struct rb_subtree *left,
+					struct rb_subtree *right)
+{
+	struct rb_setop_task t = { .op = op };
+	struct rb_node *dup;
+
+	t.a = rb_detach(a.node->rb_left, a.bh);
+	*right = rb_detach(a.node->rb_right, a.bh);
+	dup = __rb_split(b, a.node, op->cmp, &t.b, &b);
+
+	if (t.a.bh >= RB_PARALLEL_BH) {
+		thread_pool_fork(&t.task, rb_setop_run, &t);
+		*right = op->fn(*right, b, op);
+		thread_pool_join(&t.task);
+		*left = t.result;
+	} else {
+		*left = op->fn(t.a, t.b, op);
+		*right = op->fn(*right, b, op);
+	}
+	return dup;
+}
+
+static struct rb_subtree __rb_union(struct rb_subtree a, struct rb_subtree b,
+				    const struct rb_setop *op)
+{
+	struct rb_subtree left, right;
+	struct rb_node *dup;
+
+	if (!a.node)
+		return b;
+	if (!b.node)
+		return a;
+
+	dup = rb_setop_recurse(a, b, op, &left, &right);
+	if (dup)
+		rb_dispose(dup, op);
+	return __rb_join(left, a.node, right);
+}
+
+static struct rb_subtree __rb_intersection(struct rb_subtree a, struct rb_subtree b,
+					   const struct rb_setop *op)
+{
+	struct rb_subtree left, right, empty = { NULL, 0 };
+	struct rb_node *dup;
+
+	if (!a.node || !b.node) {
+		rb_dispose_tree(a.node, op);
+		rb_dispose_tree(b.node, op);
+		return empty;
+	}
+
+	dup = rb_setop_recurse(a, b, op, &left, &right);
+	if (dup) {
+		rb_dispose(dup, op);
+		return __rb_join(left, a.node, right);
+	}
+	rb_dispose(a.node, op);
+	return __rb_join2(left, right);
+}
+
+static struct rb_subtree __rb_difference(struct rb_subtree a, struct rb_subtree b,
+					 const struct rb_setop *op)
+{
+	struct rb_subtree left, right;
+	struct rb_node *dup;
+
+	if (!a.node || !b.node) {
+		rb_dispose_tree(b.node, op);
+		return a;
+	}
+
+	dup = rb_setop_recurse(a, b, op, &left, &right);
+	if (!dup)
+		return __rb_join(left, a.node, right);
+	rb_dispose(dup, op);
+	rb_dispose(a.node, op);
+	return __rb_join2(left, right);
+}
+
+static void rb_setop(struct rb_root *a, struct rb_root *b, struct rb_setop *op,
+		     struct thread_pool *pool)
+{
+	struct rb_setop_task t = { .op = op, .a = rb_subtree(a), .b = rb_subtree(b) };
+
+	if (pool)
+		thread_pool_run(pool, rb_setop_run, &t);
+	else
+		rb_setop_run(&t);
+	a->rb_node = t.result.node;
+	b->rb_node = NULL;
+}
+
+/*
+ * Concatenate @left, @mid and @right, which must sort in that order, into
+ * @left and empty @right.  @mid may be NULL.
+ */
+void rb_join(struct rb_root *left, struct rb_node *mid, struct rb_root *right)
+{
+	struct rb_subtree l = rb_subtree(left), r = rb_subtree(right);
+
+	left->rb_node = (mid ? __rb_join(l, mid, r) : __rb_join2(l, r)).node;
+	right->rb_node = NULL;
+}
+
+/*
+ * Keep the nodes that sort before @key in @root and move the ones after
+ * it to @right, whose previous contents are dropped.  The node equal to
+ * @key, if any, is taken out of the tree and returned.
+ */
+struct rb_node *rb_split(struct rb_root *root, const struct rb_node *key,
+			 rb_cmp_t cmp, struct rb_root *right)
+{
+	struct rb_subtree l, r;
+	struct rb_node *found = __rb_split(rb_subtree(root), key, cmp, &l, &r);
+
+	root->rb_node = l.node;
+	right->rb_node = r.node;
+	return found;
+}
+
+/* @a becomes a | b, keeping the node from @a for keys found in both */
+void rb_union(struct rb_root *a, struct rb_root *b, rb_cmp_t cmp,
+	      rb_dispose_t dispose, void *arg)
+{
+	struct rb_setop op = { __rb_union, cmp, dispose, arg };
+
+	rb_setop(a, b, &op, NULL);
+}
+
+/* @a becomes a & b, keeping the node from @a for keys found in both */
+void rb_intersection(struct rb_root *a, struct rb_root *b, rb_cmp_t cmp,
+		     rb_dispose_t dispose, void *arg)
+{
+	struct rb_setop op = { __rb_intersection, cmp, dispose, arg };
+
+	rb_setop(a, b, &op, NULL);
+}
+
+/* @a becomes a - b */
+void rb_difference(struct rb_root *a, struct rb_root *b, rb_cmp_t cmp,
+		   rb_dispose_t dispose, void *arg)
+{
+	struct rb_setop op = { __rb_difference, cmp, dispose, arg };
+
+	rb_setop(a, b, &op, NULL);
+}
+
+void rb_union_parallel(struct rb_root *a, struct rb_root *b, rb_cmp_t cmp,
+		       rb_dispose_t dispose, void *arg, struct thread_pool *pool)
+{
+	struct rb_setop op = { __rb_union, cmp, dispose, arg };
+
+	rb_setop(a, b, &op, pool);
+}
+
+void rb_difference_parallel(struct rb_root *a, struct rb_root *b, rb_cmp_t cmp,
+			    rb_dispose_t dispose, void *arg,
+			    struct thread_pool *pool)
+{
+	struct rb_setop op = { __rb_difference, cmp, dispose, arg };
+
+	rb_setop(a, b, &op, pool);
+}
+
+struct rb_build_task {
+	struct thread_pool_task task;
+	struct rb_node **nodes;
+	size_t n;
+	struct rb_root root;
+};
+
+/*
+ * Build the two halves around the middle node, the left one as a task,
+ * and join them.  Ranges of RB_PARALLEL_CHUNK nodes or less are built
+ * with rb_build_sorted().
+ */
+static void rb_build_run(void *data)
+{
+	struct rb_build_task *t = data;
+	struct rb_build_task left = { .nodes = t->nodes, .n = t->n / 2, .root = RB_ROOT };
+	struct rb_root right = RB_ROOT;
+	size_t mid = t->n / 2;
+
+	if (t->n <= RB_PARALLEL_CHUNK) {
+		rb_build_sorted(t->nodes, t->n, &t->root);
+		return;
+	}
+
+	thread_pool_fork(&left.task, rb_build_run, &left);
+	rb_build_sorted_parallel(t->nodes + mid + 1, t->n - mid - 1, &right, NULL);
+	thread_pool_join(&left.task);
+
+	t->root = left.root;
+	rb_join(&t->root, t->nodes[mid], &right);
+}
+
+/*
+ * rb_build_sorted() with the work spread over @pool.  A NULL @pool builds
+ * on the calling thread, forking to whatever pool it is running in.
+ */
+void rb_build_sorted_parallel(struct rb_node **nodes, size_t n,
+			      struct rb_root *root, struct thread_pool *pool)
+{
+	struct rb_build_task t = { .nodes = nodes, .n = n, .root = RB_ROOT };
+
+	if (pool)
+		thread_pool_run(pool, rb_build_run, &t);
+	else
+		rb_build_run(&t);
+	*root = t.root;
+}
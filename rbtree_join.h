@@ -0,0 +1,60 @@
+/*
+ * Join, split and set operations on rbtrees
+ *
+ * rb_join() concatenates two trees whose key ranges do not overlap, and
+ * rb_split() cuts a tree in two around a key.  Both only walk one spine,
+ * so they cost O(log n) instead of the O(n log n) of moving every node
+ * with rb_erase() and rb_insert_color().
+ *
+ * Union, intersection and difference are built on the two primitives
+ * following Blelloch et al., "Just Join for Parallel Ordered Sets": split
+ * the second tree around the root of the first, recurse on the two
+ * halves, and join the results.  For trees of m <= n nodes that is
+ * O(m log(n/m + 1)).  The two recursive calls touch disjoint nodes, so
+ * they can be run in parallel.
+ *
+ * Nodes are ordered by @cmp, which compares two nodes of the caller's
+ * structure like strcmp().  The set operations consume both trees: the
+ * result is left in @a, @b is emptied, and every node that does not make
+ * it into the result (duplicates from @b included) is handed to @dispose,
+ * which may be NULL.
+ *
+ * The _parallel variants run the same recursion on a thread_pool, forking
+ * one half at every level while subtrees are large, so @cmp and @dispose
+ * are then called from several threads at once.
+ * rb_build_sorted_parallel() builds chunks with rb_build_sorted() in
+ * parallel and joins them around the nodes in between.
+ */
+
+#ifndef _LINUX_RBTREE_JOIN_H
+#define _LINUX_RBTREE_JOIN_H
+
+#include "rbtree.h"
+
+struct thread_pool;
+
+typedef int (*rb_cmp_t)(const struct rb_node *a, const struct rb_node *b);
+typedef void (*rb_dispose_t)(struct rb_node *node, void *arg);
+
+extern void rb_join(struct rb_root *left, struct rb_node *mid,
+		    struct rb_root *right);
+extern struct rb_node *rb_split(struct rb_root *root, const struct rb_node *key,
+				rb_cmp_t cmp, struct rb_root *right);
+
+extern void rb_union(struct rb_root *a, struct rb_root *b, rb_cmp_t cmp,
+		     rb_dispose_t dispose, void *arg);
+extern void rb_intersection(struct rb_root *a, struct rb_root *b, rb_cmp_t cmp,
+			    rb_dispose_t dispose, void *arg);
+extern void rb_difference(struct rb_root *a, struct rb_root *b, rb_cmp_t cmp,
+			  rb_dispose_t dispose, void *arg);
+
+extern void rb_union_parallel(struct rb_root *a, struct rb_root *b, rb_cmp_t cmp,
+			      rb_dispose_t dispose, void *arg,
+			      struct thread_pool *pool);
+extern void rb_difference_parallel(struct rb_root *a, struct rb_root *b,
+				   rb_cmp_t cmp, rb_dispose_t dispose, void *arg,
+				   struct thread_pool *pool);
+extern void rb_build_sorted_parallel(struct rb_node **nodes, size_t n,
+				     struct rb_root *root, struct thread_pool *pool);
+
+#endif	/* _LINUX_RBTREE_JOIN_H */
@@ -0,0 +1,206 @@
+/*
+ * Latched RB-trees
+ *
+ * Since RB-trees have non-atomic modifications they're not immediately
+ * suited for RCU/lockless queries.  Even though we made the RB-tree lookups
+ * non-fatal for lockless lookups (rbtree.c never forms a loop while it
+ * restructures), we cannot guarantee they return a correct result.
+ *
+ * The simplest solution is a seqcount latch around two copies of the tree:
+ * writers update one copy at a time while readers are steered to the
+ * other, and a reader that raced with a flip simply retries.  Lookups
+ * therefore never take a lock and never write shared memory, so they
+ * scale with the number of reading cores.
+ *
+ * The costs are that all elements are linked twice (struct latch_tree_node
+ * holds two rb_nodes), writers must be serialised by the caller, and an
+ * erased element may only be freed after a grace period (see rcu.h).
+ * Readers must hold rcu_read_lock() around latch_tree_find() and around
+ * any use of its result.
+ */
+
+#ifndef _LINUX_RBTREE_LATCH_H
+#define _LINUX_RBTREE_LATCH_H
+
+#include "rbtree.h"
+
+struct latch_tree_node
+{
+	struct rb_node node[2];
+};
+
+struct latch_tree_root
+{
+	unsigned int seq;
+	struct rb_root tree[2];
+};
+
+#define LATCH_TREE_ROOT	(struct latch_tree_root) { 0, { { NULL, }, { NULL, } } }
+
+/**
+ * latch_tree_ops - operators to define the tree order
+ * @less: used for insertion; provides the (partial) order between two elements.
+ * @comp: used for lookups; provides the order between the search key and an element.
+ *
+ * The operators are related like:
+ *
+ *	comp(a->key,b) < 0  := less(a,b)
+ *	comp(a->key,b) > 0  := less(b,a)
+ *	comp(a->key,b) == 0 := !less(a,b) && !less(b,a)
+ *
+ * If these operators define a partial order on the elements we make no
+ * guarantee on which of the elements matching the key is found.
+ */
+struct latch_tree_ops
+{
+	int (*less)(struct latch_tree_node *a, struct latch_tree_node *b);
+	int (*comp)(void *key, struct latch_tree_node *b);
+};
+
+static inline void raw_write_seqcount_latch(unsigned int *seq)
+{
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline unsigned int raw_read_seqcount_latch(const unsigned int *seq)
+{
+	return __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+}
+
+static inline int read_seqcount_latch_retry(const unsigned int *seq,
+					    unsigned int start)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(seq, __ATOMIC_RELAXED) != start;
+}
+
+static inline struct latch_tree_node *__lt_from_rb(struct rb_node *node, int idx)
+{
+	return container_of(node, struct latch_tree_node, node[idx]);
+}
+
+static inline void __lt_insert(struct latch_tree_node *ltn,
+			       struct latch_tree_root *ltr, int idx,
+			       int (*less)(struct latch_tree_node *a,
+					   struct latch_tree_node *b))
+{
+	struct rb_root *root = &ltr->tree[idx];
+	struct rb_node **link = &root->rb_node;
+	struct rb_node *node = &ltn->node[idx];
+	struct rb_node *parent = NULL;
+	struct latch_tree_node *ltp;
+
+	while (*link) {
+		parent = *link;
+		ltp = __lt_from_rb(parent, idx);
+
+		if (less(ltn, ltp))
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	rb_link_node_rcu(node, parent, link);
+	rb_insert_color(node, root);
+}
+
+static inline void __lt_erase(struct latch_tree_node *ltn,
+			      struct latch_tree_root *ltr, int idx)
+{
+	rb_erase(&ltn->node[idx], &ltr->tree[idx]);
+}
+
+static inline struct latch_tree_node *
+__lt_find(void *key, struct latch_tree_root *ltr, int idx,
+	  int (*comp)(void *key, struct latch_tree_node *node))
+{
+	struct rb_node *node = rcu_dereference_raw(ltr->tree[idx].rb_node);
+	struct latch_tree_node *ltn;
+	int c;
+
+	while (node) {
+		ltn = __lt_from_rb(node, idx);
+		c = comp(key, ltn);
+
+		if (c < 0)
+			node = rcu_dereference_raw(node->rb_left);
+		else if (c > 0)
+			node = rcu_dereference_raw(node->rb_right);
+		else
+			return ltn;
+	}
+
+	return NULL;
+}
+
+/**
+ * latch_tree_insert() - insert @node into the trees @root
+ * @node: nodes to insert
+ * @root: trees to insert @node into
+ * @ops: operators defining the node order
+ *
+ * It inserts @node into @root in an ordered fashion such that we can always
+ * observe one complete tree.  The inserts into the two trees are separated
+ * by latch flips.  Writers must be serialised by the caller.
+ */
+static inline void latch_tree_insert(struct latch_tree_node *node,
+				     struct latch_tree_root *root,
+				     const struct latch_tree_ops *ops)
+{
+	raw_write_seqcount_latch(&root->seq);
+	__lt_insert(node, root, 0, ops->less);
+	raw_write_seqcount_latch(&root->seq);
+	__lt_insert(node, root, 1, ops->less);
+}
+
+/**
+ * latch_tree_erase() - removes @node from the trees @root
+ * @node: nodes to remove
+ * @root: trees to remove @node from
+ * @ops: operators defining the node order
+ *
+ * Removes @node from the trees @root in an ordered fashion such that we can
+ * always observe one complete tree.  Before @node can be freed the caller
+ * must wait for a grace period: synchronize_rcu() or call_rcu().
+ */
+static inline void latch_tree_erase(struct latch_tree_node *node,
+				    struct latch_tree_root *root,
+				    const struct latch_tree_ops *ops)
+{
+	(void)ops;
+
+	raw_write_seqcount_latch(&root->seq);
+	__lt_erase(node, root, 0);
+	raw_write_seqcount_latch(&root->seq);
+	__lt_erase(node, root, 1);
+}
+
+/**
+ * latch_tree_find() - find the node matching @key in the trees @root
+ * @key: search key
+ * @root: trees to search for @key
+ * @ops: operators defining the node order
+ *
+ * Does a lockless lookup in the trees @root for the node matching @key.
+ * The caller must hold rcu_read_lock() for as long as it uses the result.
+ *
+ * Returns: a pointer to the node matching @key or NULL.
+ */
+static inline struct latch_tree_node *
+latch_tree_find(void *key, struct latch_tree_root *root,
+		const struct latch_tree_ops *ops)
+{
+	struct latch_tree_node *node;
+	unsigned int seq;
+
+	do {
+		seq = raw_read_seqcount_latch(&root->seq);
+		node = __lt_find(key, root, seq & 1, ops->comp);
+	} while (read_seqcount_latch_retry(&root->seq, seq));
+
+	return node;
+}
+
+#endif	/* _LINUX_RBTREE_LATCH_H */
@@ -0,0 +1,142 @@
+#include <string.h>
+#include "rbtree_layout.h"
+
+struct rb_arena {
+	char *base;
+	size_t size, offset;
+	size_t nr;			/* entries copied so far */
+};
+
+static inline struct rb_node *rb_arena_node(const struct rb_arena *a, size_t i)
+{
+	return (struct rb_node *)(a->base + i * a->size + a->offset);
+}
+
+/*
+ * Once copied, an old node's rb_parent_color points to its copy.  Its
+ * children links stay intact, so the old tree can still be walked down.
+ */
+#define rb_forward(node)	((struct rb_node *)(node)->rb_parent_color)
+
+static void rb_arena_copy(struct rb_arena *a, struct rb_node *node)
+{
+	struct rb_node *copy = rb_arena_node(a, a->nr++);
+
+	memcpy((char *)copy - a->offset, (char *)node - a->offset, a->size);
+	node->rb_parent_color = (unsigned long)copy;
+}
+
+/* The copies themselves serve as the BFS queue */
+static void rb_layout_bfs(struct rb_arena *a, struct rb_node *root)
+{
+	size_t i;
+
+	rb_arena_copy(a, root);
+	for (i = 0; i < a->nr; i++) {
+		struct rb_node *copy = rb_arena_node(a, i);
+
+		if (copy->rb_left)
+			rb_arena_copy(a, copy->rb_left);
+		if (copy->rb_right)
+			rb_arena_copy(a, copy->rb_right);
+	}
+}
+
+static void rb_layout_inorder(struct rb_arena *a, struct rb_node *node)
+{
+	if (!node)
+		return;
+	rb_layout_inorder(a, node->rb_left);
+	rb_arena_copy(a, node);
+	rb_layout_inorder(a, node->rb_right);
+}
+
+static int rb_height(const struct rb_node *node)
+{
+	int left, right;
+
+	if (!node)
+		return 0;
+	left = rb_height(node->rb_left);
+	right = rb_height(node->rb_right);
+	return 1 + (left > right ? left : right);
+}
+
+static void rb_layout_veb(struct rb_arena *a, struct rb_node *node, int levels);
+
+/* Lay out every subtree rooted @depth levels below @node, @levels deep */
+static void rb_layout_veb_below(struct rb_arena *a, struct rb_node *node,
+				int depth, int levels)
+{
+	if (!node)
+		return;
+	if (!depth) {
+		rb_layout_veb(a, node, levels);
+		return;
+	}
+	rb_layout_veb_below(a, node->rb_left, depth - 1, levels);
+	rb_layout_veb_below(a, node->rb_right, depth - 1, levels);
+}
+
+/* Copy the top @levels levels of the subtree at @node in vEB order */
+static void rb_layout_veb(struct rb_arena *a, struct rb_node *node, int levels)
+{
+	int top = levels / 2;
+
+	if (levels == 1) {
+		rb_arena_copy(a, node);
+		return;
+	}
+	rb_layout_veb(a, node, top);
+	rb_layout_veb_below(a, node, top, levels - top);
+}
+
+size_t rb_relayout(struct rb_root *root, void *arena, size_t size,
+		   size_t offset, enum rb_layout layout,
+		   rb_moved_t moved, void *arg)
+{
+	struct rb_arena a = { arena, size, offset, 0 };
+	struct rb_node *old;
+	size_t i;
+
+	if (!root->rb_node)
+		return 0;
+
+	if (layout == RB_LAYOUT_BFS)
+		rb_layout_bfs(&a, root->rb_node);
+	else if (layout == RB_LAYOUT_VEB)
+		rb_layout_veb(&a, root->rb_node, rb_height(root->rb_node));
+	else
+		rb_layout_inorder(&a, root->rb_node);
+
+	/*
+	 * The copies still link to old nodes.  Follow each old link to its
+	 * copy, and point the copy's parent back at the node we came from,
+	 * so that every forwarding pointer is read exactly once and the old
+	 * node can be let go right after.
+	 */
+	old = root->rb_node;
+	root->rb_node = rb_forward(old);
+	rb_set_parent(root->rb_node, NULL);
+	if (moved)
+		moved((char *)old - offset, (char *)root->rb_node - offset, arg);
+
+	for (i = 0; i < a.nr; i++) {
+		struct rb_node *copy = rb_arena_node(&a, i);
+
+		if ((old = copy->rb_left)) {
+			copy->rb_left = rb_forward(old);
+			rb_set_parent(copy->rb_left, copy);
+			if (moved)
+				moved((char *)old - offset, (char *)copy->rb_left - offset, arg);
+		}
+		if ((old = copy->rb_right)) {
+			copy->rb_right = rb_forward(old);
+			rb_set_parent(copy->rb_right, copy);
+			if (moved)
+				moved((char *)old - offset, (char *)copy->rb_right - offset, arg);
+		}
+	}
+
+	return a.nr;
+}
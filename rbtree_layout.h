@@ -0,0 +1,46 @@
+/*
+ * Relayout of an rbtree into one contiguous arena
+ *
+ * After a long run of insertions and erasures the nodes of a tree are
+ * spread all over the heap, so every step of a lookup or of an rb_next()
+ * walk is likely a cache and a TLB miss.  rb_relayout() copies every entry
+ * into @arena, in an order chosen for the expected access pattern, and
+ * relinks the copies:
+ *
+ *  RB_LAYOUT_BFS	level by level; the top levels, which every lookup
+ *			goes through, share a few cache lines and pages.
+ *  RB_LAYOUT_VEB	van Emde Boas: the top half of the levels, then each
+ *			subtree hanging below them, recursively, so any
+ *			root-to-leaf path touches O(log_B n) blocks whatever
+ *			the block size B.
+ *  RB_LAYOUT_INORDER	in key order, for rb_first()/rb_next() walks.
+ *
+ * Entries are @size bytes with their rb_node @offset bytes in, and are
+ * copied with memcpy(), so they must not point into themselves.  Colours
+ * and shape are unchanged.  @arena must have room for every node.
+ *
+ * The old entries are left unlinked, with a clobbered rb_node, and each
+ * is passed to @moved (which may be NULL) together with its copy, once
+ * nothing reads it any more; @moved can free it or update references to
+ * it.  Returns the number of entries copied.
+ */
+
+#ifndef _LINUX_RBTREE_LAYOUT_H
+#define _LINUX_RBTREE_LAYOUT_H
+
+#include <stddef.h>
+#include "rbtree.h"
+
+enum rb_layout {
+	RB_LAYOUT_BFS,
+	RB_LAYOUT_VEB,
+	RB_LAYOUT_INORDER,
+};
+
+typedef void (*rb_moved_t)(void *old, void *new, void *arg);
+
+extern size_t rb_relayout(struct rb_root *root, void *arena, size_t size,
+			  size_t offset, enum rb_layout layout,
+			  rb_moved_t moved, void *arg);
+
+#endif	/* _LINUX_RBTREE_LAYOUT_H */
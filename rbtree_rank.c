@@ -0,0 +1,65 @@
+#include "rbtree_rank.h"
+#include "rbtree_augmented.h"
+
+static inline unsigned long rb_rank_compute_size(struct rb_rank_node *node)
+{
+	return 1 + rb_rank_size(node->rb.rb_left) + rb_rank_size(node->rb.rb_right);
+}
+
+RB_DECLARE_CALLBACKS(static, rb_rank_augment, struct rb_rank_node, rb,
+		     unsigned long, rb_subtree_size, rb_rank_compute_size)
+
+void rb_rank_insert(struct rb_rank_node *node, struct rb_node *parent,
+		    struct rb_node **rb_link, struct rb_root *root)
+{
+	struct rb_node *rb;
+
+	/* Every ancestor of the new leaf gains one descendant */
+	for (rb = parent; rb; rb = rb_parent(rb))
+		rb_rank_entry(rb)->rb_subtree_size++;
+
+	node->rb_subtree_size = 1;
+	rb_link_node(&node->rb, parent, rb_link);
+	rb_insert_augmented(&node->rb, root, &rb_rank_augment);
+}
+
+void rb_rank_erase(struct rb_rank_node *node, struct rb_root *root)
+{
+	rb_erase_augmented(&node->rb, root, &rb_rank_augment);
+}
+
+/*
+ * Return the node with exactly @k nodes before it in sort order, or NULL
+ * if the tree holds @k nodes or fewer.
+ */
+struct rb_rank_node *rb_select(const struct rb_root *root, unsigned long k)
+{
+	struct rb_node *node = root->rb_node;
+
+	while (node) {
+		unsigned long left = rb_rank_size(node->rb_left);
+
+		if (k < left)
+			node = node->rb_left;
+		else if (k > left) {
+			k -= left + 1;
+			node = node->rb_right;
+		} else
+			return rb_rank_entry(node);
+	}
+	return NULL;
+}
+
+/* Return the number of nodes that sort before @node */
+unsigned long rb_rank(const struct rb_rank_node *node)
+{
+	const struct rb_node *rb = &node->rb, *parent;
+	unsigned long rank = rb_rank_size(rb->rb_left);
+
+	while ((parent = rb_parent(rb)) != NULL) {
+		if (rb == parent->rb_right)
+			rank += rb_rank_size(parent->rb_left) + 1;
+		rb = parent;
+	}
+	return rank;
+}
@@ -0,0 +1,40 @@
+/*
+ * Order-statistic rbtrees
+ *
+ * Every node carries the size of its subtree, maintained through the
+ * augmented rbtree callbacks, which makes "k-th smallest" (rb_select) and
+ * "position of this node" (rb_rank) O(log n) instead of an rb_next() walk.
+ *
+ * Embed struct rb_rank_node in your own structure and do the usual
+ * descent to find @parent and @link, then call rb_rank_insert() instead of
+ * rb_link_node() + rb_insert_color().  Erase with rb_rank_erase().  Ranks
+ * are 0-based and follow the in-order sequence of the tree.
+ */
+
+#ifndef _LINUX_RBTREE_RANK_H
+#define _LINUX_RBTREE_RANK_H
+
+#include "rbtree.h"
+
+struct rb_rank_node
+{
+	struct rb_node rb;
+	unsigned long rb_subtree_size;
+};
+
+#define rb_rank_entry(ptr)	rb_entry(ptr, struct rb_rank_node, rb)
+
+static inline unsigned long rb_rank_size(const struct rb_node *rb)
+{
+	return rb ? rb_rank_entry(rb)->rb_subtree_size : 0;
+}
+
+extern void rb_rank_insert(struct rb_rank_node *node, struct rb_node *parent,
+			   struct rb_node **rb_link, struct rb_root *root);
+extern void rb_rank_erase(struct rb_rank_node *node, struct rb_root *root);
+
+extern struct rb_rank_node *rb_select(const struct rb_root *root,
+				      unsigned long k);
+extern unsigned long rb_rank(const struct rb_rank_node *node);
+
+#endif	/* _LINUX_RBTREE_RANK_H */
@@ -0,0 +1,112 @@
+#include <pthread.h>
+#include <sched.h>
+#include "rcu.h"
+
+/* Flush call_rcu() callbacks once this many are queued */
+#define RCU_BATCH	1024
+
+__thread struct rcu_reader rcu_reader;
+unsigned long rcu_gp_ctr = 1;
+
+static pthread_mutex_t rcu_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rcu_reader *rcu_registry;
+
+static pthread_mutex_t rcu_callback_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct rcu_head *rcu_callbacks;
+static unsigned long rcu_callback_count;
+
+void rcu_register_thread(void)
+{
+	if (rcu_reader.registered)
+		return;
+
+	pthread_mutex_lock(&rcu_registry_lock);
+	rcu_reader.next = rcu_registry;
+	rcu_registry = &rcu_reader;
+	rcu_reader.registered = 1;
+	pthread_mutex_unlock(&rcu_registry_lock);
+}
+
+void rcu_unregister_thread(void)
+{
+	struct rcu_reader **r;
+
+	if (!rcu_reader.registered)
+		return;
+
+	pthread_mutex_lock(&rcu_registry_lock);
+	for (r = &rcu_registry; *r; r = &(*r)->next) {
+		if (*r == &rcu_reader) {
+			*r = rcu_reader.next;
+			break;
+		}
+	}
+	rcu_reader.registered = 0;
+	pthread_mutex_unlock(&rcu_registry_lock);
+}
+
+/*
+ * Start a new grace period and wait until every registered reader is
+ * either quiescent or entered its read-side section after it started.
+ */
+void synchronize_rcu(void)
+{
+	struct rcu_reader *r;
+	unsigned long gp, ctr;
+
+	pthread_mutex_lock(&rcu_registry_lock);
+	gp = __atomic_add_fetch(&rcu_gp_ctr, 1, __ATOMIC_SEQ_CST);
+
+	for (r = rcu_registry; r; r = r->next) {
+		while ((ctr = __atomic_load_n(&r->ctr, __ATOMIC_SEQ_CST)) &&
+		       ctr < gp)
+			sched_yield();
+	}
+	pthread_mutex_unlock(&rcu_registry_lock);
+
+	/* Order the readers' exits before the caller's reclamation */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *head))
+{
+	int flush;
+
+	head->func = func;
+
+	pthread_mutex_lock(&rcu_callback_lock);
+	head->next = rcu_callbacks;
+	rcu_callbacks = head;
+	flush = ++rcu_callback_count >= RCU_BATCH;
+	pthread_mutex_unlock(&rcu_callback_lock);
+
+	/*
+	 * The flush waits for a grace period, which a caller inside a
+	 * read-side section would never see end: leave it to the next
+	 * call_rcu() made outside one.
+	 */
+	if (flush && !rcu_reader.nesting)
+		rcu_barrier();
+}
+
+/* Wait for a grace period and run every callback queued before it */
+void rcu_barrier(void)
+{
+	struct rcu_head *head, *next;
+
+	pthread_mutex_lock(&rcu_callback_lock);
+	head = rcu_callbacks;
+	rcu_callbacks = NULL;
+	rcu_callback_count = 0;
+	pthread_mutex_unlock(&rcu_callback_lock);
+
+	if (!head)
+		return;
+
+	synchronize_rcu();
+
+	for (; head; head = next) {
+		next = head->next;
+		head->func(head);
+	}
+}
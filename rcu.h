@@ -0,0 +1,63 @@
+#ifndef _RB_RCU_H
+#define _RB_RCU_H
+
+/*
+ * Minimal userspace RCU, good enough to reclaim nodes erased from trees
+ * that are walked by lockless readers (see rbtree_latch.h).
+ *
+ * Readers register once per thread and bracket each lookup with
+ * rcu_read_lock()/rcu_read_unlock(), which only touch a thread-local
+ * counter.  Writers unlink a node and then either wait for all readers
+ * that might still see it with synchronize_rcu(), or queue it with
+ * call_rcu() and free batches later via rcu_barrier().
+ *
+ * synchronize_rcu() and rcu_barrier() must not be called from inside a
+ * read-side section.  call_rcu() may be: once a batch of callbacks is
+ * queued it flushes them with rcu_barrier(), but only when the caller is
+ * outside any read-side section, so callbacks queued from within one wait
+ * for a later call_rcu() or rcu_barrier().
+ */
+
+struct rcu_head
+{
+	struct rcu_head *next;
+	void (*func)(struct rcu_head *head);
+};
+
+struct rcu_reader
+{
+	unsigned long ctr;	/* 0 when quiescent, else grace period seen */
+	unsigned long nesting;
+	struct rcu_reader *next;
+	int registered;
+};
+
+extern __thread struct rcu_reader rcu_reader;
+extern unsigned long rcu_gp_ctr;
+
+extern void rcu_register_thread(void);
+extern void rcu_unregister_thread(void);
+
+static inline void rcu_read_lock(void)
+{
+	if (rcu_reader.nesting++ == 0) {
+		__atomic_store_n(&rcu_reader.ctr,
+				 __atomic_load_n(&rcu_gp_ctr, __ATOMIC_RELAXED),
+				 __ATOMIC_RELAXED);
+		/* Publish ctr before loading any tree pointer */
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	}
+}
+
+static inline void rcu_read_unlock(void)
+{
+	if (--rcu_reader.nesting == 0)
+		__atomic_store_n(&rcu_reader.ctr, 0, __ATOMIC_RELEASE);
+}
+
+extern void synchronize_rcu(void);
+extern void call_rcu(struct rcu_head *head,
+		     void (*func)(struct rcu_head *head));
+extern void rcu_barrier(void);
+
+#endif	/* _RB_RCU_H */
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#include "results.h"
+
+/* Set by the Makefile to the flags the benchmark objects were built with */
+#ifndef BENCH_CFLAGS
+#define BENCH_CFLAGS	"unknown"
+#endif
+
+static FILE *results_file;
+static char results_prefix[2048];
+
+/* Fields are not quoted: commas inside them become spaces */
+static void results_field(char *dst, size_t size, const char *src)
+{
+	size_t i;
+
+	for (i = 0; i + 1 < size && src[i]; i++)
+		dst[i] = (src[i] == ',' || src[i] == '\n') ? ' ' : src[i];
+	dst[i] = '\0';
+}
+
+static void results_cpu_model(char *buf, size_t size)
+{
+	char line[256];
+	FILE *f = fopen("/proc/cpuinfo", "r");
+
+	results_field(buf, size, "unknown");
+	if (!f)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		char *colon = strchr(line, ':');
+
+		if (strncmp(line, "model name", 10) == 0 && colon) {
+			size_t len;
+
+			results_field(buf, size, colon + 2);
+			len = strlen(buf);
+			while (len && buf[len - 1] == ' ')
+				buf[--len] = '\0';
+			break;
+		}
+	}
+	fclose(f);
+}
+
+int results_open(const char *path, const char *driver)
+{
+	char host[256] = "unknown", cpu[256], kernel[256], compiler[256], cflags[256], name[64], stamp[32];
+	struct utsname uts;
+	time_t now = time(NULL);
+
+	results_file = fopen(path, "w");
+	if (!results_file) {
+		perror("Error opening results file");
+		return -1;
+	}
+
+	gethostname(host, sizeof(host) - 1);
+	results_field(host, sizeof(host), host);
+	results_cpu_model(cpu, sizeof(cpu));
+	if (uname(&uts) == 0) {
+		char release[sizeof(uts.release) + sizeof(uts.machine) + 2];
+
+		snprintf(release, sizeof(release), "%s %s", uts.release, uts.machine);
+		results_field(kernel, sizeof(kernel), release);
+	} else {
+		results_field(kernel, sizeof(kernel), "unknown");
+	}
+#ifdef __VERSION__
+	results_field(compiler, sizeof(compiler), "gcc " __VERSION__);
+#else
+	results_field(compiler, sizeof(compiler), "unknown");
+#endif
+	results_field(cflags, sizeof(cflags), BENCH_CFLAGS);
+	results_field(name, sizeof(name), driver);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+	snprintf(results_prefix, sizeof(results_prefix), "%s,%s,%s,%s,%s,%s,%s",
+		 stamp, host, cpu, kernel, compiler, cflags, name);
+	fprintf(results_file, "%s\n", RESULTS_HEADER);
+	return 0;
+}
+
+void results_add(const char *benchmark, const char *tree, const char *workload,
+		 long n, const struct bench_stats *st)
+{
+	char b[128], t[128], w[128];
+
+	if (!results_file)
+		return;
+	results_field(b, sizeof(b), benchmark);
+	results_field(t, sizeof(t), tree);
+	results_field(w, sizeof(w), workload);
+	fprintf(results_file, "%s,%s,%s,%s,%ld,ns/op,%d,%f,%f,%f,%f,%f,%f,%f,%f\n",
+		results_prefix, b, t, w, n, st->samples, st->mean, st->stddev,
+		st->ci95, st->min, st->median, st->p90, st->p99, st->max);
+}
+
+void results_close(void)
+{
+	if (results_file)
+		fclose(results_file);
+	results_file = NULL;
+}
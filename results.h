@@ -0,0 +1,25 @@
+/*
+ * Structured benchmark results
+ *
+ * Every timed measurement of a run becomes one CSV row that is
+ * self-describing: when and where it ran (host, CPU, kernel, compiler and
+ * flags), what was measured (benchmark, tree, workload, N) and the
+ * bench_stats of its ns/op samples.  Files from two runs can be diffed
+ * with bench-compare, which flags statistically significant regressions.
+ */
+
+#ifndef _RESULTS_H
+#define _RESULTS_H
+
+#include "bench.h"
+
+#define RESULTS_HEADER	"timestamp,host,cpu,kernel,compiler,cflags,driver,benchmark,tree,workload," \
+			"n,unit,samples,mean,stddev,ci95,min,median,p90,p99,max"
+
+/* Returns 0, or -1 if @path cannot be written (results_add() is then a no-op) */
+extern int results_open(const char *path, const char *driver);
+extern void results_add(const char *benchmark, const char *tree, const char *workload,
+			long n, const struct bench_stats *stats);
+extern void results_close(void);
+
+#endif	/* _RESULTS_H */
@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <sched.h>
+#include "thread_pool.h"
+
+/* The worker the current thread runs as, NULL outside any pool */
+static __thread struct thread_pool_worker *thread_pool_self;
+
+static void thread_pool_execute(struct thread_pool_task *task)
+{
+	task->fn(task->arg);
+	__atomic_store_n(&task->done, 1, __ATOMIC_RELEASE);
+}
+
+/* Take the oldest task of another worker, trying each of them once */
+static struct thread_pool_task *thread_pool_steal(struct thread_pool_worker *self)
+{
+	struct thread_pool *pool = self->pool;
+	struct thread_pool_task *task = NULL;
+	int i, start;
+
+	if (!__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST))
+		return NULL;
+
+	self->seed = self->seed * 1103515245 + 12345;
+	start = (self->seed >> 16) % pool->nr_threads;
+	for (i = 0; i < pool->nr_threads && !task; i++) {
+		struct thread_pool_worker *victim = &pool->workers[(start + i) % pool->nr_threads];
+
+		if (victim == self)
+			continue;
+		pthread_mutex_lock(&victim->lock);
+		if (victim->top != victim->bottom)
+			task = victim->deque[victim->top++ % THREAD_POOL_DEQUE];
+		pthread_mutex_unlock(&victim->lock);
+	}
+	if (task)
+		__atomic_sub_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+	return task;
+}
+
+static void *thread_pool_worker_main(void *data)
+{
+	struct thread_pool_worker *self = data;
+	struct thread_pool *pool = self->pool;
+	int stop;
+
+	thread_pool_self = self;
+	do {
+		struct thread_pool_task *task = thread_pool_steal(self);
+
+		if (task) {
+			thread_pool_execute(task);
+			continue;
+		}
+
+		/*
+		 * Sleep until something is queued.  thread_pool_fork() bumps
+		 * @queued before it looks at @idle, and we bump @idle before
+		 * looking at @queued, so one of the two always notices the
+		 * other and no wakeup is lost.
+		 */
+		pthread_mutex_lock(&pool->lock);
+		__atomic_add_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+		while (!__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST) && !pool->stop)
+			pthread_cond_wait(&pool->wake, &pool->lock);
+		__atomic_sub_fetch(&pool->idle, 1, __ATOMIC_SEQ_CST);
+		stop = pool->stop;
+		pthread_mutex_unlock(&pool->lock);
+	} while (!stop);
+
+	return NULL;
+}
+
+/* Returns 0, or -1 if no worker thread could be started */
+int thread_pool_init(struct thread_pool *pool, int nr_threads)
+{
+	int i;
+
+	if (nr_threads < 1)
+		nr_threads = 1;
+	pool->workers = calloc(nr_threads, sizeof(struct thread_pool_worker));
+	if (!pool->workers)
+		return -1;
+	pool->nr_threads = nr_threads;
+	pool->queued = pool->idle = pool->stop = 0;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->wake, NULL);
+
+	for (i = 0; i < nr_threads; i++) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].seed = i + 1;
+		pthread_mutex_init(&pool->workers[i].lock, NULL);
+	}
+
+	/* Worker 0 is whoever calls thread_pool_run() */
+	for (i = 1; i < nr_threads; i++) {
+		if (pthread_create(&pool->workers[i].thread, NULL,
+				   thread_pool_worker_main, &pool->workers[i])) {
+			pool->nr_threads = i;
+			thread_pool_destroy(pool);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+void thread_pool_destroy(struct thread_pool *pool)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 1; i < pool->nr_threads; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+	for (i = 0; i < pool->nr_threads; i++)
+		pthread_mutex_destroy(&pool->workers[i].lock);
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->workers);
+}
+
+void thread_pool_run(struct thread_pool *pool, void (*fn)(void *arg), void *arg)
+{
+	struct thread_pool_worker *prev = thread_pool_self;
+
+	thread_pool_self = &pool->workers[0];
+	fn(arg);
+	thread_pool_self = prev;
+}
+
+void thread_pool_fork(struct thread_pool_task *task, void (*fn)(void *arg), void *arg)
+{
+	struct thread_pool_worker *self = thread_pool_self;
+	struct thread_pool *pool;
+
+	task->fn = fn;
+	task->arg = arg;
+	task->done = 0;
+
+	if (!self || self->pool->nr_threads == 1) {
+		thread_pool_execute(task);
+		return;
+	}
+
+	pthread_mutex_lock(&self->lock);
+	if (self->bottom - self->top == THREAD_POOL_DEQUE) {
+		pthread_mutex_unlock(&self->lock);
+		thread_pool_execute(task);
+		return;
+	}
+	self->deque[self->bottom++ % THREAD_POOL_DEQUE] = task;
+	pthread_mutex_unlock(&self->lock);
+
+	pool = self->pool;
+	__atomic_add_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&pool->idle, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&pool->lock);
+		pthread_cond_signal(&pool->wake);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+void thread_pool_join(struct thread_pool_task *task)
+{
+	struct thread_pool_worker *self = thread_pool_self;
+
+	if (__atomic_load_n(&task->done, __ATOMIC_ACQUIRE))
+		return;
+
+	/*
+	 * Forks nest, so a task that was not stolen is still at the bottom
+	 * of our own deque: everything forked after it has been joined.
+	 */
+	pthread_mutex_lock(&self->lock);
+	if (self->top != self->bottom &&
+	    self->deque[(self->bottom - 1) % THREAD_POOL_DEQUE] == task) {
+		self->bottom--;
+		pthread_mutex_unlock(&self->lock);
+		__atomic_sub_fetch(&self->pool->queued, 1, __ATOMIC_SEQ_CST);
+		thread_pool_execute(task);
+		return;
+	}
+	pthread_mutex_unlock(&self->lock);
+
+	/* Stolen: make ourselves useful until the thief finishes it */
+	while (!__atomic_load_n(&task->done, __ATOMIC_ACQUIRE)) {
+		struct thread_pool_task *other = thread_pool_steal(self);
+
+		if (other)
+			thread_pool_execute(other);
+		else
+			sched_yield();
+	}
+}
@@ -0,0 +1,69 @@
+/*
+ * Work-stealing thread pool for fork/join parallelism
+ *
+ * thread_pool_run() executes a function on the calling thread with the
+ * pool's workers standing by.  Inside it, thread_pool_fork() pushes a
+ * task on the calling worker's deque and returns at once; idle workers
+ * steal the oldest (and so, for divide and conquer, the largest) task
+ * from the top of somebody's deque.  thread_pool_join() waits for a forked
+ * task: if nobody stole it, it is popped and run right there, otherwise
+ * the joining worker steals other work until the thief is done.
+ *
+ * Outside thread_pool_run() there is no worker to queue on, and a fork
+ * simply runs the task before returning, so recursive code written
+ * against this API also runs unchanged on a single thread.
+ *
+ * Forks and joins must nest like function calls, and the task structure
+ * has to stay alive until thread_pool_join() returns; a task on the stack
+ * of the forking function is the usual choice.  One thread_pool_run() at
+ * a time per pool.
+ */
+
+#ifndef _THREAD_POOL_H
+#define _THREAD_POOL_H
+
+#include <pthread.h>
+
+/* Deepest nesting of outstanding forks per worker; deeper forks run inline */
+#define THREAD_POOL_DEQUE	64
+
+struct thread_pool_task
+{
+	void (*fn)(void *arg);
+	void *arg;
+	int done;
+};
+
+struct thread_pool;
+
+struct thread_pool_worker
+{
+	pthread_t thread;
+	pthread_mutex_t lock;
+	struct thread_pool_task *deque[THREAD_POOL_DEQUE];
+	unsigned int top, bottom;	/* thieves take at top, the owner at bottom */
+	unsigned int seed;		/* picks the first victim to steal from */
+	struct thread_pool *pool;
+};
+
+struct thread_pool
+{
+	int nr_threads;
+	struct thread_pool_worker *workers;	/* [0] is thread_pool_run()'s caller */
+	int queued;			/* tasks sitting in some deque */
+	int idle;			/* workers asleep on @wake */
+	int stop;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+};
+
+extern int thread_pool_init(struct thread_pool *pool, int nr_threads);
+extern void thread_pool_destroy(struct thread_pool *pool);
+extern void thread_pool_run(struct thread_pool *pool, void (*fn)(void *arg),
+			    void *arg);
+
+extern void thread_pool_fork(struct thread_pool_task *task,
+			     void (*fn)(void *arg), void *arg);
+extern void thread_pool_join(struct thread_pool_task *task);
+
+#endif	/* _THREAD_POOL_H */
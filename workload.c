@@ -0,0 +1,156 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "workload.h"
+
+const char *const workload_dist_names[WORKLOAD_NR_DISTS] = {
+	[WORKLOAD_UNIFORM]	= "uniform",
+	[WORKLOAD_ZIPFIAN]	= "zipfian",
+	[WORKLOAD_SEQUENTIAL]	= "sequential",
+	[WORKLOAD_LATEST]	= "latest",
+};
+
+#define ZIPFIAN_THETA	0.99
+
+/* splitmix64: tiny, fast, and every seed (including 0) gives a good stream */
+uint64_t workload_rand(struct workload *wl)
+{
+	uint64_t z = (wl->rng += 0x9e3779b97f4a7c15ull);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+static double workload_rand_double(struct workload *wl)
+{
+	return (workload_rand(wl) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* FNV-1a, to spread zipfian ranks so hot keys do not cluster in one subtree */
+static uint64_t fnv1a64(uint64_t v)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		h ^= v & 0xff;
+		h *= 0x100000001b3ull;
+		v >>= 8;
+	}
+	return h;
+}
+
+/* Gray et al., "Quickly Generating Billion-Record Synthetic Databases" */
+static long zipfian_rank(struct workload *wl)
+{
+	double u = workload_rand_double(wl);
+	double uz = u * wl->zetan;
+
+	if (uz < 1.0)
+		return 0;
+	if (uz < 1.0 + pow(0.5, wl->theta))
+		return 1;
+	return (long)(wl->records * pow(wl->eta * u - wl->eta + 1.0, wl->alpha)) % wl->records;
+}
+
+void workload_init(struct workload *wl, enum workload_dist dist,
+		   const struct workload_mix *mix, long records, uint64_t seed)
+{
+	long i;
+
+	memset(wl, 0, sizeof(*wl));
+	wl->dist = dist;
+	wl->mix = *mix;
+	wl->rng = seed;
+	wl->records = records > 0 ? records : 1;
+	wl->next_key = wl->records;
+
+	if (dist == WORKLOAD_ZIPFIAN || dist == WORKLOAD_LATEST) {
+		wl->theta = ZIPFIAN_THETA;
+		for (i = 1; i <= wl->records; i++)
+			wl->zetan += 1.0 / pow(i, wl->theta);
+		wl->zeta2 = 1.0 + 1.0 / pow(2, wl->theta);
+		wl->alpha = 1.0 / (1.0 - wl->theta);
+		wl->eta = (1.0 - pow(2.0 / wl->records, 1.0 - wl->theta)) /
+			  (1.0 - wl->zeta2 / wl->zetan);
+	}
+}
+
+void workload_load_keys(struct workload *wl, int *keys)
+{
+	long i, j;
+	int tmp;
+
+	for (i = 0; i < wl->records; i++)
+		keys[i] = i;
+	if (wl->dist == WORKLOAD_SEQUENTIAL || wl->dist == WORKLOAD_LATEST)
+		return;
+
+	for (i = wl->records - 1; i > 0; i--) {
+		j = workload_rand(wl) % (i + 1);
+		tmp = keys[i];
+		keys[i] = keys[j];
+		keys[j] = tmp;
+	}
+}
+
+/* An existing (or once existing) key, picked by the distribution */
+static long workload_pick(struct workload *wl)
+{
+	long key;
+
+	switch (wl->dist) {
+	case WORKLOAD_ZIPFIAN:
+		return fnv1a64(zipfian_rank(wl)) % wl->next_key;
+	case WORKLOAD_SEQUENTIAL:
+		if (wl->cursor >= wl->next_key)
+			wl->cursor = 0;
+		return wl->cursor++;
+	case WORKLOAD_LATEST:
+		key = wl->next_key - 1 - zipfian_rank(wl);
+		return key < 0 ? 0 : key;
+	default:
+		return workload_rand(wl) % wl->next_key;
+	}
+}
+
+enum workload_op workload_next(struct workload *wl, int *key)
+{
+	unsigned int r = workload_rand(wl) % 100;
+
+	if (r < wl->mix.read) {
+		*key = workload_pick(wl);
+		return WORKLOAD_READ;
+	}
+	if (r < wl->mix.read + wl->mix.insert) {
+		*key = wl->next_key++;
+		return WORKLOAD_INSERT;
+	}
+	*key = workload_pick(wl);
+	return WORKLOAD_DELETE;
+}
+
+int workload_parse_dist(const char *name)
+{
+	int i;
+
+	for (i = 0; i < WORKLOAD_NR_DISTS; i++)
+		if (strcmp(name, workload_dist_names[i]) == 0)
+			return i;
+	return -1;
+}
+
+int workload_parse_mix(const char *str, struct workload_mix *mix)
+{
+	unsigned int read, insert, delete;
+
+	if (sscanf(str, "%u/%u/%u", &read, &insert, &delete) != 3 ||
+	    read + insert + delete != 100)
+		return -1;
+	mix->read = read;
+	mix->insert = insert;
+	mix->delete = delete;
+	return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * YCSB-style workload generator
+ *
+ * A workload starts from a table of @records keys, loaded in the order
+ * workload_load_keys() returns, and then produces an interleaved stream of
+ * reads, inserts and deletes in the proportions of a struct workload_mix
+ * ("90/5/5" is 90% reads, 5% inserts, 5% deletes).  Inserts always add a
+ * new key one past the largest so far, like timestamps; the distribution
+ * decides which existing keys reads and deletes pick:
+ *
+ *	uniform		every key equally likely
+ *	zipfian		a few hot keys (theta 0.99), scattered over the key space
+ *	sequential	keys in increasing order, wrapping around
+ *	latest		zipfian over recency: the newest keys are the hottest
+ *
+ * The generator has its own seeded PRNG, so the same seed replays the same
+ * operation stream against every tree being compared.
+ */
+
+#ifndef _WORKLOAD_H
+#define _WORKLOAD_H
+
+#include <stdint.h>
+
+enum workload_dist {
+	WORKLOAD_UNIFORM,
+	WORKLOAD_ZIPFIAN,
+	WORKLOAD_SEQUENTIAL,
+	WORKLOAD_LATEST,
+	WORKLOAD_NR_DISTS
+};
+
+enum workload_op {
+	WORKLOAD_READ,
+	WORKLOAD_INSERT,
+	WORKLOAD_DELETE
+};
+
+/* Percentages, summing to 100 */
+struct workload_mix
+{
+	unsigned int read, insert, delete;
+};
+
+struct workload
+{
+	enum workload_dist dist;
+	struct workload_mix mix;
+	uint64_t rng;
+	long records;			/* keys loaded initially: 0 .. records - 1 */
+	long next_key;			/* the next insert's key */
+	long cursor;			/* sequential position */
+
+	/* Zipfian constants over @records items */
+	double theta, zetan, zeta2, alpha, eta;
+};
+
+extern const char *const workload_dist_names[WORKLOAD_NR_DISTS];
+
+extern void workload_init(struct workload *wl, enum workload_dist dist,
+			  const struct workload_mix *mix, long records, uint64_t seed);
+
+/*
+ * The initial @records keys in load order: ascending for sequential and
+ * latest (monotonic timestamps), a seeded shuffle otherwise.
+ */
+extern void workload_load_keys(struct workload *wl, int *keys);
+
+/* Next operation of the stream, and its key in @key */
+extern enum workload_op workload_next(struct workload *wl, int *key);
+
+extern uint64_t workload_rand(struct workload *wl);
+
+/* "uniform", "zipfian", ...; -1 if unknown */
+extern int workload_parse_dist(const char *name);
+/* "read/insert/delete" percentages; 0 on success, -1 if malformed */
+extern int workload_parse_mix(const char *str, struct workload_mix *mix);
+
+#endif	/* _WORKLOAD_H */